@@ -0,0 +1 @@
+-flto
@@ -1,13 +1,43 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <WiFiUdp.h>
+#include <Preferences.h>
 #include <driver/i2s.h>
+#include <lwip/sockets.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <esp_cpu.h>
+#include <esp_pm.h>
+#include <esp_wifi.h>
+#include <esp_task_wdt.h>
+#include <esp_system.h>
+#include <freertos/semphr.h>
+#include <atomic>
+
+// ========= Build profiles (compile-time specialization) =========
+// This file is the single streamer source. The old
+// esp32/udp_inmp441_streamer sketch - a divergent copy of the same capture
+// loop - is now a thin wrapper that predefines a handful of HA_* / config
+// macros and includes this file, so role, pin map, shift, frame size and
+// pipeline stages all resolve at compile time and every build target gets a
+// fully specialized hot loop (shapeSampleT<> below compiles disabled stages
+// out entirely). Anything a wrapper may override is guarded with #ifndef;
+// editing the defaults here still works the way it always did. Build with
+// LTO (build_opt.h next to the wrapper sketch passes -flto) so the
+// specialized kernels inline across the whole image.
+#define HA_ROLE_LEFT 0
+#define HA_ROLE_RIGHT 1
+#ifndef HA_ROLE
+#define HA_ROLE HA_ROLE_LEFT
+#endif
 
 // I2S Microphone Pins (INMP441)
 // Using safe GPIO pins that avoid flash (47-48), PSRAM (33-37), USB (19-20), and strapping pins
 // Set to 1 to use the original "demo" wiring (WS=2, SCK=1, SD=41).
 // Set to 0 to use the alternate wiring used by this file previously (WS=5, SCK=4, SD=6).
+#ifndef USE_DEMO_PINS
 #define USE_DEMO_PINS 1
+#endif
 
 #if USE_DEMO_PINS
 #define I2S0_WS 2   // Word Select (LRCLK)
@@ -19,6 +49,35 @@
 #define I2S0_SD 6   // Serial Data (DOUT from mic -> DIN on ESP32)
 #endif
 
+// Whichever wiring is NOT selected above is pre-staged on the second I2S
+// controller as a warm standby (mono builds), so a field mic swap between
+// the two headers is a control command instead of a reflash.
+#if USE_DEMO_PINS
+#define I2S_ALT_WS 5
+#define I2S_ALT_SCK 4
+#define I2S_ALT_SD 6
+#else
+#define I2S_ALT_WS 2
+#define I2S_ALT_SCK 1
+#define I2S_ALT_SD 41
+#endif
+
+// Dual-microphone mode: capture a second INMP441 on the other I2S controller
+// (I2S_NUM_1) and stream one interleaved L/R packet, instead of flashing two
+// boards and letting the server align two independent clocks. Both controllers
+// clock from the same APB source, so the channels stay frequency-locked, and
+// setupI2S restarts both DMAs back-to-back to keep the start skew well under
+// one sample. Mic 0 is the LEFT channel, mic 1 the RIGHT.
+#ifndef DUAL_MIC
+#define DUAL_MIC 0
+#endif
+
+#if DUAL_MIC
+#define I2S1_WS 15   // Word Select (LRCLK), second mic
+#define I2S1_SCK 16  // Bit Clock (BCLK), second mic
+#define I2S1_SD 17   // Serial Data (DOUT from mic -> DIN on ESP32)
+#endif
+
 #define VDD1 7  // Power pin (optional)
 
 // If you power the microphone from GPIO (not recommended long-term), set this to true.
@@ -38,33 +97,1720 @@
 #define FORCE_GPIO48_LOW false
 
 // WiFi credentials - CHANGE THESE!
-const char* ssid = "nwHacks2026";
-const char* password = "nw_Hacks_2026";
+#ifndef WIFI_SSID
+#define WIFI_SSID "nwHacks2026"
+#define WIFI_PASSWORD "nw_Hacks_2026"
+#endif
+const char* ssid = WIFI_SSID;
+const char* password = WIFI_PASSWORD;
+
+// UDP settings. The default port follows the role, matching the bridge's
+// left=12345 / right=12346 convention.
+#ifndef UDP_DEST_ADDR
+#define UDP_DEST_ADDR "10.19.134.79"  // CHANGE to your computer's IP
+#endif
+#ifndef UDP_DEST_PORT
+#define UDP_DEST_PORT (HA_ROLE == HA_ROLE_RIGHT ? 12346 : 12345)
+#endif
+const char* udpAddress = UDP_DEST_ADDR;
+const int udpPort = UDP_DEST_PORT;
+
+// Runtime copies of the stream destination. Initialised from the constants
+// above, overridden from NVS ("net" namespace) at boot, and retargetable live
+// over the control channel, so moving a node to a new server no longer means
+// a reflash.
+static char g_dest_addr[16] = {0};
+static uint16_t g_dest_port = 0;
+
+// ========= Fast Wi-Fi connect =========
+// Boot-to-streaming used to be 5-10 s: blocking scan + associate + DHCP.
+// We persist the AP's BSSID and channel in NVS after each successful
+// association, so a warm boot or roam can skip the scan, and optionally use a
+// static IP to skip DHCP too. If the fast path times out (AP moved channel,
+// BSSID changed) we fall back to a full scan and refresh the cache.
+#define USE_STATIC_IP 0
+#if USE_STATIC_IP
+const char* staticIp = "10.19.134.200";
+const char* staticGateway = "10.19.134.1";
+const char* staticSubnet = "255.255.255.0";
+#endif
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 3000
+#define WIFI_FULL_CONNECT_TIMEOUT_MS 20000
+
+static Preferences g_prefs;
+
+static bool waitForWifi(uint32_t timeout_ms) {
+  uint32_t waited = 0;
+  while (WiFi.status() != WL_CONNECTED && waited < timeout_ms) {
+    // The loop task blocks here through AP outages (fast retry + 20 s full
+    // fallback), which outlasts its 15 s task WDT; feed it so an outage
+    // doesn't become a panic-reset loop that flushes the frame ring. Before
+    // setup() subscribes the task this returns a not-found error, harmlessly.
+    esp_task_wdt_reset();
+    delay(50);
+    waited += 50;
+  }
+  return WiFi.status() == WL_CONNECTED;
+}
+
+// ========= Wi-Fi TX performance profile =========
+// Stack defaults queue bursts in the radio driver that surface as 20-50 ms
+// send-latency spikes once several nodes share an AP. The tunables we can
+// reach at runtime: radio TX power (esp_wifi_set_max_tx_power, quarter-dBm
+// units, reapplied on every association), the DSCP/TOS byte on the audio
+// socket (0xB8 = Expedited Forwarding, which the driver maps to the WMM
+// voice access category), and the lwIP socket send buffer. AMPDU
+// aggregation is a build-time IDF option (CONFIG_ESP_WIFI_AMPDU_TX_ENABLED),
+// not a runtime switch - disable it in sdkconfig for latency-critical
+// fleets. Loaded from NVS at boot, adjustable over the control channel,
+// echoed in the stats report for A/B placement tests.
+struct WifiTxProfile {
+  int8_t max_tx_power_q2;  // quarter dBm, 8..84 (2..21 dBm); 78 = default
+  uint8_t tos;             // DSCP/TOS for the audio socket; 0xB8 = EF/AC_VO
+  uint32_t sndbuf;         // lwIP send buffer bytes; 0 = stack default
+};
+
+static WifiTxProfile g_wifi_tx = {78, 0xB8, 0};
+
+static void wifiTxApplyRadio() {
+  esp_err_t err = esp_wifi_set_max_tx_power(g_wifi_tx.max_tx_power_q2);
+  if (err != ESP_OK) {
+    Serial.printf("WiFi: set_max_tx_power(%d) failed (%d)\n",
+                  (int)g_wifi_tx.max_tx_power_q2, (int)err);
+  }
+}
+
+static void wifiTxApplySocket(int sock) {
+  if (sock < 0) return;
+  int tos = g_wifi_tx.tos;
+  setsockopt(sock, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+  if (g_wifi_tx.sndbuf != 0) {
+    int buf = (int)g_wifi_tx.sndbuf;
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+  }
+}
+
+static void loadWifiTxProfile() {
+  g_prefs.begin("wifitx", true);
+  g_wifi_tx.max_tx_power_q2 = (int8_t)g_prefs.getChar("pwr", g_wifi_tx.max_tx_power_q2);
+  g_wifi_tx.tos = g_prefs.getUChar("tos", g_wifi_tx.tos);
+  g_wifi_tx.sndbuf = g_prefs.getUInt("buf", g_wifi_tx.sndbuf);
+  g_prefs.end();
+  if (g_wifi_tx.max_tx_power_q2 < 8) g_wifi_tx.max_tx_power_q2 = 8;
+  if (g_wifi_tx.max_tx_power_q2 > 84) g_wifi_tx.max_tx_power_q2 = 84;
+}
+
+// ========= Power management =========
+// Head-worn nodes run on battery; pinning the CPU at full clock while
+// i2s_read() blocks on DMA and keeping the radio hot burns charge for
+// nothing. The battery profile enables esp_pm frequency scaling with
+// automatic light sleep (80-240 MHz; the capture/convert/send deadline
+// fits with a wide margin - see the stage histograms) plus Wi-Fi modem
+// sleep. The default performance profile keeps everything pinned for
+// minimum latency. Switched over the control channel and persisted in
+// NVS; the active profile and current clock ride along in the stats
+// packet so placements can be compared in the field.
+#define POWER_MODE_PERF 0
+#define POWER_MODE_BATTERY 1
+
+static uint8_t g_power_mode = POWER_MODE_PERF;
+
+static bool powerApply(uint8_t mode) {
+#if defined(CONFIG_IDF_TARGET_ESP32S3)
+  esp_pm_config_esp32s3_t pm;
+#else
+  esp_pm_config_esp32_t pm;
+#endif
+  if (mode == POWER_MODE_BATTERY) {
+    pm.max_freq_mhz = 240;
+    pm.min_freq_mhz = 80;
+    pm.light_sleep_enable = true;
+  } else {
+    pm.max_freq_mhz = 240;
+    pm.min_freq_mhz = 240;
+    pm.light_sleep_enable = false;
+  }
+  esp_err_t err = esp_pm_configure(&pm);
+  if (err != ESP_OK && pm.light_sleep_enable) {
+    // Light sleep needs tickless idle in the core config; DFS alone still
+    // saves a useful amount.
+    pm.light_sleep_enable = false;
+    err = esp_pm_configure(&pm);
+  }
+  if (err != ESP_OK) {
+    Serial.printf("Power: esp_pm_configure failed (%d)\n", (int)err);
+    return false;
+  }
+  g_power_mode = mode;
+  WiFi.setSleep(mode == POWER_MODE_BATTERY);
+  Serial.printf("Power: %s profile (cpu %d-%d MHz, light sleep %d, modem sleep %d)\n",
+                mode == POWER_MODE_BATTERY ? "battery" : "performance",
+                pm.min_freq_mhz, pm.max_freq_mhz,
+                pm.light_sleep_enable ? 1 : 0,
+                mode == POWER_MODE_BATTERY ? 1 : 0);
+  return true;
+}
+
+static bool connectWiFi() {
+  WiFi.mode(WIFI_STA);
+  WiFi.setSleep(g_power_mode == POWER_MODE_BATTERY);
+  WiFi.persistent(false);
+#if USE_STATIC_IP
+  IPAddress ip, gw, sn;
+  if (ip.fromString(staticIp) && gw.fromString(staticGateway) && sn.fromString(staticSubnet)) {
+    WiFi.config(ip, gw, sn);
+  }
+#endif
+
+  uint8_t cached_bssid[6];
+  uint8_t cached_chan = 0;
+  g_prefs.begin("wifi", false);
+  bool have_cached = g_prefs.getBytes("bssid", cached_bssid, sizeof(cached_bssid)) == sizeof(cached_bssid);
+  if (have_cached) cached_chan = g_prefs.getUChar("chan", 0);
+  have_cached = have_cached && cached_chan != 0;
+
+  if (have_cached) {
+    // Directed associate: no scan, straight to the remembered BSSID/channel.
+    WiFi.begin(ssid, password, cached_chan, cached_bssid, true);
+    if (!waitForWifi(WIFI_FAST_CONNECT_TIMEOUT_MS)) {
+      WiFi.disconnect();
+      WiFi.begin(ssid, password);
+      waitForWifi(WIFI_FULL_CONNECT_TIMEOUT_MS);
+    }
+  } else {
+    WiFi.begin(ssid, password);
+    waitForWifi(WIFI_FULL_CONNECT_TIMEOUT_MS);
+  }
+
+  bool connected = WiFi.status() == WL_CONNECTED;
+  if (connected) {
+    wifiTxApplyRadio();  // TX power resets with the association
+    uint8_t* bssid = WiFi.BSSID();
+    uint8_t chan = (uint8_t)WiFi.channel();
+    if (bssid != NULL && (!have_cached || memcmp(bssid, cached_bssid, 6) != 0 || chan != cached_chan)) {
+      g_prefs.putBytes("bssid", bssid, 6);
+      g_prefs.putUChar("chan", chan);
+    }
+  }
+  g_prefs.end();
+  return connected;
+}
+
+// Transport backend: 1 = one connected lwIP UDP socket opened at startup and
+// reused for every frame (single send() per packet, no per-packet destination
+// resolution or stream-abstraction copy), 0 = the old Arduino WiFiUDP path.
+#define USE_LWIP_UDP 1
+
+// Native WebSocket transport (docs/ESP32_Protocol.md section 2.2): speak the
+// /esp32/audio endpoint directly instead of routing through the laptop's
+// udp_to_ws_bridge.py - one less copy, process and scheduling delay in the
+// STT path. Off by default; the UDP paths above remain the field default.
+#define USE_WEBSOCKET 0
+#define WS_SERVER_PORT 8765
+#define WS_PATH "/esp32/audio"
+#ifndef DEVICE_ID
+#if HA_ROLE == HA_ROLE_RIGHT
+#define DEVICE_ID "esp32-right-01"
+#else
+#define DEVICE_ID "esp32-master-01"
+#endif
+#endif
+#ifndef DEVICE_ROLE
+#define DEVICE_ROLE (HA_ROLE == HA_ROLE_RIGHT ? "right" : "left")
+#endif
+#define FW_VERSION "0.1.0"
+
+WiFiUDP udp;            // fallback transport (USE_LWIP_UDP == 0)
+static int g_udp_sock = -1;
+#if USE_WEBSOCKET
+static int g_ws_sock = -1;
+static bool wsSendFrame(uint8_t opcode, const uint8_t* data, size_t len);
+#endif
 
-// UDP settings
-const char* udpAddress = "10.19.134.79";  // CHANGE to your computer's IP
-const int udpPort = 12345;
+// Open and connect the raw UDP socket once; after this each frame is a single
+// send() straight into lwIP.
+static bool udpTransportInit() {
+#if USE_LWIP_UDP
+  g_udp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (g_udp_sock < 0) {
+    Serial.println("ERROR: UDP socket() failed");
+    return false;
+  }
+  struct sockaddr_in dest;
+  memset(&dest, 0, sizeof(dest));
+  dest.sin_family = AF_INET;
+  dest.sin_port = htons(g_dest_port);
+  dest.sin_addr.s_addr = inet_addr(g_dest_addr);
+  if (connect(g_udp_sock, (struct sockaddr*)&dest, sizeof(dest)) != 0) {
+    Serial.println("ERROR: UDP connect() failed");
+    close(g_udp_sock);
+    g_udp_sock = -1;
+    return false;
+  }
+  wifiTxApplySocket(g_udp_sock);
+#endif
+  return true;
+}
+
+// ========= Multi-sink fanout =========
+// The same stream is often wanted in two places at once - the live server
+// plus a ring recorder for incident review. Fanning out here costs one
+// sendto() per extra sink on the already-prepared wire image (no copy, no
+// re-encode); the laptop-side tee costs an entire receive/parse/resend
+// pipeline. Extra sinks go out on a separate unconnected socket so the
+// primary keeps its connected-socket fast path (and its return channel for
+// sync/control). Session-scoped: configured over the control channel, not
+// persisted.
+#define MAX_EXTRA_SINKS 3
+
+struct UdpSink {
+  struct sockaddr_in addr;
+  uint32_t ip;   // kept for the stats line
+  uint16_t port;
+  uint32_t send_failures;
+};
+
+static UdpSink g_extra_sinks[MAX_EXTRA_SINKS];
+static int g_extra_sink_count = 0;
+static int g_fanout_sock = -1;
+
+#if USE_LWIP_UDP && !USE_WEBSOCKET
+static void fanoutSend(const uint8_t* data, size_t len) {
+  for (int i = 0; i < g_extra_sink_count; i++) {
+    if (sendto(g_fanout_sock, data, len, 0, (struct sockaddr*)&g_extra_sinks[i].addr,
+               sizeof(g_extra_sinks[i].addr)) != (int)len) {
+      g_extra_sinks[i].send_failures++;
+    }
+  }
+}
+#endif
 
-WiFiUDP udp;
+// Send one prepared frame payload. Returns true if the full datagram was
+// handed to the network stack (primary sink; extra sinks only bump their
+// own failure counters).
+static bool sendFrameBytes(const uint8_t* data, size_t len) {
+#if USE_WEBSOCKET
+  return wsSendFrame(0x2, data, len);  // one binary message per datagram image
+#elif USE_LWIP_UDP
+  if (g_udp_sock < 0) return false;
+  if (g_extra_sink_count > 0 && g_fanout_sock >= 0) fanoutSend(data, len);
+  return send(g_udp_sock, data, len, 0) == (int)len;
+#else
+  udp.beginPacket(g_dest_addr, g_dest_port);
+  udp.write(data, len);
+  return udp.endPacket() == 1;
+#endif
+}
 
-// I2S configuration
+// I2S configuration. SAMPLE_RATE/BUFFER_SIZE are the defaults and compile-time
+// maxima (buffers are statically sized from BUFFER_SIZE); the values actually
+// used come from the runtime profile below.
+#ifndef SAMPLE_RATE
 #define SAMPLE_RATE 16000
+#endif
+// Also the default samples-per-frame: the streamer wrapper sets 320 to keep
+// its historical 20 ms frames, this file's default stays 512 (32 ms).
+#ifndef BUFFER_SIZE
 #define BUFFER_SIZE 512
+#endif
+
+// ========= Audio/latency profile =========
+// Different deployments want different trade-offs: the subtitle path wants
+// small frames for latency, the recording path deep DMA for resilience.
+// Loaded from NVS ("audio" namespace: rate/frameMs/dma) at boot so a node can
+// run e.g. 10 ms frames without a firmware fork; defaults reproduce the
+// historical 512-sample / 8-buffer configuration. Samples per frame are
+// derived from frame_ms the way udp_inmp441_streamer derives them from
+// FRAME_MS.
+struct AudioProfile {
+  uint32_t sample_rate;   // Hz
+  uint16_t frame_ms;      // frame granularity in milliseconds
+  uint8_t dma_buf_count;  // I2S DMA queue depth
+};
+
+static AudioProfile g_profile = {SAMPLE_RATE, (BUFFER_SIZE * 1000) / SAMPLE_RATE, 8};
+static int g_samples_per_frame = BUFFER_SIZE;
+#if DUAL_MIC
+#define NUM_CHANNELS 2
+#else
+#define NUM_CHANNELS 1
+#endif
 int32_t i2s_buffer[BUFFER_SIZE];
-uint8_t udp_buffer[BUFFER_SIZE * 2];  // 16-bit samples
+#if DUAL_MIC
+int32_t i2s_buffer2[BUFFER_SIZE];  // second mic (I2S_NUM_1)
+#else
+// Single-mic builds capture the bus in stereo (both WS phases) and pick the
+// live slot in software. The mic only drives one slot, so this doubles DMA
+// traffic but makes an L/R mismatch recoverable between frames: a channel
+// swap is a flip of g_active_slot instead of the old ~100 ms
+// uninstall/reinstall cycle in reinitI2S().
+int32_t i2s_stereo_buffer[BUFFER_SIZE * 2];
+static int g_active_slot = DEFAULT_USE_RIGHT_CHANNEL ? 1 : 0;  // 0/1 within each stereo frame
+
+// ========= I2S warm standby (alternate pin map) =========
+// Field mic swaps happen mid-event, and moving between the demo and
+// alternate wiring used to mean editing USE_DEMO_PINS and reflashing - 2+
+// minutes of downtime per node - or riding reinitI2S() through a teardown.
+// Mono builds instead pre-stage the alternate pin map on the idle second
+// controller: on a control command, or when the stuck-at-zero detector has
+// given up on both slots of the active bus, the capture task pulls a probe
+// frame from the standby bus, checks it for signal, and retargets the port
+// it reads between frames. The previous bus stays installed and becomes
+// the new standby, so cutting back is just as cheap. Costs one extra DMA
+// queue of internal RAM; the probe itself leans on the active bus's DMA
+// depth to avoid dropping frames.
+static i2s_port_t g_capture_port = I2S_NUM_0;
+static bool g_standby_installed = false;
+static volatile bool g_standby_probe = false;  // one-shot probe/cutover request
+#endif
+
+// ========= WebSocket client (USE_WEBSOCKET) =========
+// Minimal RFC 6455 client over an lwIP TCP socket: HTTP upgrade, one JSON
+// hello text frame, then each prepared datagram image goes out unchanged as
+// one binary message (the framed format below, so stats/sync/bench packets
+// survive the transport swap; the server sees "ha-framed" in the hello).
+// TCP gives ordering/reliability, so the send policy is the opposite of
+// UDP's: any short write or error tears the connection down and the link
+// monitor reconnects - no partial frames ever hit the stream. Backpressure
+// lands in the frame ring, where the sender drops oldest rather than
+// stalling capture.
+#if USE_WEBSOCKET
+
+// Two tasks write this socket - the sender task ships audio frames, the loop
+// task answers pings - and a frame is two send() calls (header, payload).
+// The mutex keeps whole frames contiguous on the TCP stream; without it the
+// writers can interleave mid-frame and corrupt the RFC 6455 framing.
+static SemaphoreHandle_t g_ws_tx_lock = NULL;
+
+// Inbound bytes accumulate here across recv() boundaries; TCP makes no
+// promise that a read starts (or ends) on a frame edge.
+static uint8_t g_ws_rx[256];
+static size_t g_ws_rx_len = 0;
+static size_t g_ws_rx_skip = 0;  // remainder of an oversized frame being drained
+
+static void wsTeardown() {
+  if (g_ws_sock >= 0) close(g_ws_sock);
+  g_ws_sock = -1;
+  g_ws_rx_len = 0;
+  g_ws_rx_skip = 0;
+}
+
+// Teardown for the receive and supervision paths, which run on the loop task
+// while the sender may sit between the header and payload send() of a frame.
+// Closing the socket under it would hand lwIP a dead (or recycled) fd
+// mid-frame, so these paths take the TX mutex first - cheap, since none of
+// them are on the audio path. wsSendFrame tears down inline on send failure
+// and already holds the lock, so it keeps calling wsTeardown() directly.
+static void wsTeardownLocked() {
+  if (g_ws_tx_lock) xSemaphoreTake(g_ws_tx_lock, portMAX_DELAY);
+  wsTeardown();
+  if (g_ws_tx_lock) xSemaphoreGive(g_ws_tx_lock);
+}
+
+static bool wsSendRaw(const uint8_t* d, size_t len) {
+  size_t off = 0;
+  while (off < len) {
+    int n = send(g_ws_sock, d + off, len - off, 0);
+    if (n <= 0) return false;
+    off += (size_t)n;
+  }
+  return true;
+}
+
+static bool wsSendFrame(uint8_t opcode, const uint8_t* data, size_t len) {
+  if (g_ws_sock < 0) return false;
+  uint8_t hdr[8];
+  size_t h = 0;
+  hdr[h++] = (uint8_t)(0x80 | opcode);  // FIN + opcode, no fragmentation
+  if (len < 126) {
+    hdr[h++] = (uint8_t)(0x80 | len);
+  } else {
+    hdr[h++] = 0x80 | 126;
+    hdr[h++] = (uint8_t)(len >> 8);
+    hdr[h++] = (uint8_t)(len & 0xff);
+  }
+  // Clients must set the mask bit; an all-zero key makes the XOR a no-op, so
+  // the payload needs no masking pass (and stays zero-copy).
+  hdr[h++] = 0;
+  hdr[h++] = 0;
+  hdr[h++] = 0;
+  hdr[h++] = 0;
+  if (g_ws_tx_lock) xSemaphoreTake(g_ws_tx_lock, portMAX_DELAY);
+  bool ok = g_ws_sock >= 0 && wsSendRaw(hdr, h) && wsSendRaw(data, len);
+  if (!ok) wsTeardown();
+  if (g_ws_tx_lock) xSemaphoreGive(g_ws_tx_lock);
+  return ok;
+}
+
+static bool wsTransportInit() {
+  if (g_ws_tx_lock == NULL) g_ws_tx_lock = xSemaphoreCreateMutex();
+  g_ws_rx_len = 0;
+  g_ws_rx_skip = 0;
+  g_ws_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (g_ws_sock < 0) return false;
+  struct sockaddr_in dest;
+  memset(&dest, 0, sizeof(dest));
+  dest.sin_family = AF_INET;
+  dest.sin_port = htons(WS_SERVER_PORT);
+  dest.sin_addr.s_addr = inet_addr(g_dest_addr);
+  if (connect(g_ws_sock, (struct sockaddr*)&dest, sizeof(dest)) != 0) {
+    Serial.println("ERROR: WS TCP connect() failed");
+    close(g_ws_sock);
+    g_ws_sock = -1;
+    return false;
+  }
+  int one = 1;
+  setsockopt(g_ws_sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  wifiTxApplySocket(g_ws_sock);
+  struct timeval tmo = {0, 100000};  // 100 ms send budget; anything slower is backpressure
+  setsockopt(g_ws_sock, SOL_SOCKET, SO_SNDTIMEO, &tmo, sizeof(tmo));
+  struct timeval rcv = {3, 0};  // handshake read timeout
+  setsockopt(g_ws_sock, SOL_SOCKET, SO_RCVTIMEO, &rcv, sizeof(rcv));
+
+  char req[256];
+  int rn = snprintf(req, sizeof(req),
+                    "GET %s?deviceId=%s&role=%s HTTP/1.1\r\n"
+                    "Host: %s:%d\r\n"
+                    "Upgrade: websocket\r\n"
+                    "Connection: Upgrade\r\n"
+                    "Sec-WebSocket-Key: aGFja2F0aG9uLWtleS0wMQ==\r\n"
+                    "Sec-WebSocket-Version: 13\r\n\r\n",
+                    WS_PATH, DEVICE_ID, DEVICE_ROLE, g_dest_addr, WS_SERVER_PORT);
+  if (!wsSendRaw((const uint8_t*)req, (size_t)rn)) {
+    close(g_ws_sock);
+    g_ws_sock = -1;
+    return false;
+  }
+  // Accept-key validation skipped: same trust level as the hardcoded Wi-Fi
+  // credentials; we only check that the server agreed to upgrade.
+  char resp[256];
+  size_t got = 0;
+  while (got < sizeof(resp) - 1) {
+    int n = recv(g_ws_sock, resp + got, sizeof(resp) - 1 - got, 0);
+    if (n <= 0) break;
+    got += (size_t)n;
+    resp[got] = 0;
+    if (strstr(resp, "\r\n\r\n") != NULL) break;
+  }
+  resp[got] = 0;
+  if (strstr(resp, " 101 ") == NULL) {
+    Serial.println("ERROR: WS upgrade refused");
+    close(g_ws_sock);
+    g_ws_sock = -1;
+    return false;
+  }
+
+  char hello[256];
+  int hn = snprintf(hello, sizeof(hello),
+                    "{\"v\":1,\"type\":\"hello\",\"deviceId\":\"%s\",\"role\":\"%s\","
+                    "\"fwVersion\":\"%s\",\"audio\":{\"format\":\"ha-framed\","
+                    "\"sampleRateHz\":%lu,\"channels\":%d,\"frameMs\":%u}}",
+                    DEVICE_ID, DEVICE_ROLE, FW_VERSION,
+                    (unsigned long)g_profile.sample_rate, NUM_CHANNELS,
+                    (unsigned)g_profile.frame_ms);
+  if (!wsSendFrame(0x1, (const uint8_t*)hello, (size_t)hn)) return false;
+  Serial.printf("WS: connected to %s:%d%s\n", g_dest_addr, WS_SERVER_PORT, WS_PATH);
+  return true;
+}
+
+// Consume one complete frame from the reassembly buffer. Returns false when
+// more bytes are needed (or the connection went away).
+static bool wsConsumeFrame() {
+  if (g_ws_rx_len < 2) return false;
+  uint8_t opcode = g_ws_rx[0] & 0x0f;
+  size_t hlen = 2;
+  uint64_t plen = g_ws_rx[1] & 0x7f;
+  if (plen == 126) {
+    if (g_ws_rx_len < 4) return false;
+    plen = ((uint64_t)g_ws_rx[2] << 8) | g_ws_rx[3];
+    hlen = 4;
+  } else if (plen == 127) {
+    if (g_ws_rx_len < 10) return false;
+    plen = 0;
+    for (int i = 0; i < 8; i++) plen = (plen << 8) | g_ws_rx[2 + i];
+    hlen = 10;
+  }
+  // Servers must not mask, but stay in sync if one does.
+  if (g_ws_rx[1] & 0x80) hlen += 4;
+  if (hlen + plen > sizeof(g_ws_rx)) {
+    // Larger than the buffer (a verbose text ack): nothing in it we act on.
+    // Drop what we hold and drain the rest unparsed; control frames we do
+    // care about are <= 125 bytes by RFC 6455 and always fit.
+    if (g_ws_rx_len < hlen) return false;
+    g_ws_rx_skip = (size_t)(hlen + plen) - g_ws_rx_len;
+    g_ws_rx_len = 0;
+    return false;
+  }
+  if (g_ws_rx_len < hlen + plen) return false;
+  if (opcode == 0x9) {  // ping -> pong with the same payload
+    wsSendFrame(0xA, g_ws_rx + hlen, (size_t)plen);
+    if (g_ws_sock < 0) return false;  // pong send tore the connection down
+  } else if (opcode == 0x8) {  // close
+    wsTeardownLocked();
+    return false;
+  }
+  size_t total = hlen + (size_t)plen;
+  memmove(g_ws_rx, g_ws_rx + total, g_ws_rx_len - total);
+  g_ws_rx_len -= total;
+  return true;
+}
+
+// Service the downstream direction: answer pings, honor close, discard the
+// rest (text acks/config are not consumed yet). Called from loop().
+static void wsPoll() {
+  if (g_ws_sock < 0) return;
+  int n;
+  for (;;) {
+    if (g_ws_rx_skip > 0) {
+      uint8_t sink[64];
+      size_t want = g_ws_rx_skip < sizeof(sink) ? g_ws_rx_skip : sizeof(sink);
+      n = recv(g_ws_sock, sink, want, MSG_DONTWAIT);
+      if (n <= 0) break;
+      g_ws_rx_skip -= (size_t)n;
+      continue;
+    }
+    n = recv(g_ws_sock, g_ws_rx + g_ws_rx_len, sizeof(g_ws_rx) - g_ws_rx_len, MSG_DONTWAIT);
+    if (n <= 0) break;
+    g_ws_rx_len += (size_t)n;
+    while (wsConsumeFrame()) {
+    }
+    if (g_ws_sock < 0) return;  // close frame (or failed pong) during parse
+  }
+  if (n == 0) {  // orderly shutdown from the server
+    wsTeardownLocked();
+  }
+}
+#endif  // USE_WEBSOCKET
+
+// Transport-agnostic (re)connect used by setup() and the link monitor.
+static bool transportInit() {
+#if USE_WEBSOCKET
+  return wsTransportInit();
+#else
+  return udpTransportInit();
+#endif
+}
+
+// ========= Capture/send pipeline =========
+// Capture runs pinned to core 0 (drains I2S DMA, converts to PCM16) and the
+// sender runs pinned to core 1 (UDP), so a Wi-Fi stall can no longer back up
+// into the I2S DMA queue. The two tasks share a single-producer/single-consumer
+// ring of converted frames; head/tail are the only shared state.
+#define CAPTURE_CORE 0
+#define SENDER_CORE 1
+#define CAPTURE_TASK_PRIO 10
+#define SENDER_TASK_PRIO 9
+#define FRAME_RING_SIZE 8      // internal-RAM fallback, ~256 ms at 512 samples/frame
+#define PSRAM_RING_SECONDS 8   // deep ring target when PSRAM is present
+
+// ========= Packet framing =========
+// Compact binary header prepended to every datagram (see docs/ESP32_Protocol.md,
+// "UDP packet header"). Sequence + device timestamp let the server detect loss
+// and reordering and run a jitter buffer instead of stalling the STT feed.
+// All fields little-endian (native ESP32 byte order).
+#define PACKET_MAGIC 0x4148  // "HA" (hudglasses audio)
+#define PACKET_VERSION 2     // v2: header carries per-frame RMS/peak/zero-cross
+
+// Header flag bits
+#define PKT_FLAG_STEREO 0x01     // payload is interleaved L/R PCM16
+#define PKT_FLAG_ADPCM 0x02      // payload is IMA-ADPCM (4-byte state + nibbles)
+#define PKT_FLAG_KEEPALIVE 0x04  // header-only keepalive; reserved carries RMS
+#define PKT_FLAG_STATS 0x08      // payload is a StatsPacket, not audio
+#define PKT_FLAG_SYNC 0x10       // payload is a SyncPayload clock exchange
+#define PKT_FLAG_CONTROL 0x20    // payload is a ControlPayload command/ack
+#define PKT_FLAG_BENCH 0x40      // synthetic benchmark traffic; receivers discard
+#define PKT_FLAG_HALF_RATE 0x80  // payload decimated to half the profile rate
+
+// Audio packets carry a sample-format code in the low byte of 'reserved'
+// (keepalives reuse the field for RMS; they have no payload to describe).
+#define PCM_FMT_S16 0  // pcm_s16le, the default
+#define PCM_FMT_S24 1  // packed 3-byte little-endian, full INMP441 resolution
+
+struct __attribute__((packed)) PacketHeader {
+  uint16_t magic;         // PACKET_MAGIC
+  uint8_t version;        // PACKET_VERSION
+  uint8_t flags;          // PKT_FLAG_* bits, 0 for plain mono PCM16
+  uint32_t seq;           // increments per packet, wraps
+  uint64_t timestamp_us;  // esp_timer microseconds at I2S read completion
+  uint16_t sample_count;  // samples per channel encoded in the payload
+  uint16_t reserved;      // audio: PCM_FMT_* code; keepalive: frame RMS
+  // Direction pre-features, computed in the fused conversion pass (s16
+  // projection). The server's radar/edge-glow path can run header-only -
+  // no PCM decode - and keeps updating even for VAD-gated keepalives.
+  uint16_t rms;           // per-frame RMS
+  uint16_t peak;          // peak |sample|
+  uint16_t zero_cross;    // zero crossings in the frame
+  uint16_t reserved2;
+};
+
+// Frame slots hold the final wire image, header included. In PCM mode the
+// conversion kernel stores int16_t words straight into payload (the ESP32 is
+// little-endian, so that's already pcm_s16le); in ADPCM mode the encoder
+// writes its block there instead. Either way the sender hands header+payload
+// to the network stack as one contiguous buffer.
+// Widest mono format is packed 24-bit (3 bytes/sample); dual-mic stays PCM16.
+#if DUAL_MIC
+#define FRAME_PAYLOAD_MAX (BUFFER_SIZE * NUM_CHANNELS * 2)
+#else
+#define FRAME_PAYLOAD_MAX (BUFFER_SIZE * 3)
+#endif
+
+struct AudioFrame {
+  PacketHeader hdr;
+  uint8_t payload[FRAME_PAYLOAD_MAX];
+  int sample_count;    // per channel
+  size_t payload_len;  // bytes actually used in payload
+};
+
+static_assert(sizeof(PacketHeader) == 28, "header layout is part of the wire format");
+static_assert(offsetof(AudioFrame, payload) == sizeof(PacketHeader), "payload must directly follow the header on the wire");
+
+// The ring lives in PSRAM when the board has it (several seconds deep, so
+// audio captured during an AP roam or retransmission storm is burst-drained
+// once the radio recovers); otherwise it falls back to a small internal-RAM
+// ring. Allocated once in ringInit() before the tasks start.
+static AudioFrame frame_ring_internal[FRAME_RING_SIZE];
+static AudioFrame* frame_ring = frame_ring_internal;
+static uint32_t g_ring_frames = FRAME_RING_SIZE;
+
+// Lock-free SPSC ring: only the capture task writes head, only the sender
+// task writes tail. acquire/release keeps the frame payload visible across
+// cores without a mutex in the audio path.
+static std::atomic<uint32_t> ring_head{0};  // next slot capture writes
+static std::atomic<uint32_t> ring_tail{0};  // next slot sender reads
+
+// ========= Frame batching =========
+// Each 512-sample packet pays ~70 bytes of UDP/IP/802.11 overhead plus airtime
+// contention; with many nodes the packet rate becomes the bottleneck. With
+// g_batch_frames > 1 the sender coalesces up to that many ready frames into
+// one datagram. Every frame keeps its own header, so batched datagrams are
+// self-describing: receivers walk header -> payload -> header. Runtime-tunable
+// so the server can push nodes back to single-frame packets when it wants low
+// latency for active speech.
+//
+// g_batch_frames is a request, not a size: the sender also enforces a byte
+// budget so a coalesced datagram never exceeds the ~1472-byte UDP payload
+// that fits one Wi-Fi MTU. Past that lwIP silently IP-fragments, and losing
+// any one fragment loses every frame in the datagram - batching would then
+// amplify loss instead of cutting packet rate. The effective frame count per
+// datagram therefore follows the live chunk size: 512-sample PCM16 chunks
+// (1052 B) don't batch at all, 320-sample chunks fit two, ADPCM chunks fit
+// the full four.
+#define BATCH_MAX_FRAMES 4
+#define BATCH_MAX_BYTES 1400  // headroom under the 1472 B MTU-sized payload
+static uint32_t g_batch_frames = 1;  // 1 = no batching
+
+static void ringInit() {
+  uint32_t frames = (PSRAM_RING_SECONDS * g_profile.sample_rate) / (uint32_t)g_samples_per_frame;
+  AudioFrame* p = (AudioFrame*)heap_caps_malloc((size_t)frames * sizeof(AudioFrame), MALLOC_CAP_SPIRAM);
+  if (p != NULL) {
+    frame_ring = p;
+    g_ring_frames = frames;
+    Serial.printf("Frame ring: %lu frames (~%d s) in PSRAM\n", (unsigned long)frames, PSRAM_RING_SECONDS);
+  } else {
+    Serial.printf("Frame ring: no PSRAM, %d frames in internal RAM\n", FRAME_RING_SIZE);
+  }
+}
+
+static TaskHandle_t capture_task_handle = NULL;
+static TaskHandle_t sender_task_handle = NULL;
+static TaskHandle_t stats_task_handle = NULL;
+
+// ========= Async diagnostics =========
+// The audio path never touches the UART: capture/sender only bump these
+// counters, and a low-priority stats task samples and prints them every
+// STATS_REPORT_MS. Each field has a single writer; torn reads on the report
+// side are harmless.
+#define STATS_TASK_PRIO 1
+#define STATS_REPORT_MS 2000
+// Consecutive all-zero frames before we try the one-shot L/R channel swap
+// (~3.2 s at 512 samples/frame, matching the old every-100-packets check).
+#define ZERO_STREAK_SWAP_THRESHOLD 100
+
+struct PipelineCounters {
+  uint32_t frames_captured;
+  uint32_t frames_sent;
+  uint32_t frames_dropped;   // ring-full overruns (capture task only)
+  uint32_t frames_aged_out;  // oldest frames evicted by the sender's drop-oldest path
+  uint32_t i2s_read_errors;
+  uint32_t send_failures;    // udp.endPacket() returned 0
+  uint32_t channel_swaps;    // auto L/R swaps triggered by all-zero input
+  uint32_t zero_frame_streak;
+  uint32_t frames_gated;     // full payloads suppressed by the energy gate
+  uint32_t wifi_reconnects;  // link drops recovered by the loop() monitor
+  uint32_t pin_failovers;    // cutovers to/from the warm-standby pin map
+  uint32_t stall_recoveries; // staged watchdog actions (socket/Wi-Fi/I2S)
+};
+
+static volatile PipelineCounters g_counters;
+
+// ========= Hot-path instrumentation =========
+// esp_cpu_get_cycle_count()-based timers around the three pipeline stages
+// (I2S read block, convert/encode, UDP send), feeding fixed log2-microsecond
+// bucket histograms. Permanent surface: the stats task prints a summary and
+// exports the raw histograms in a periodic stats packet, so fleet nodes can
+// be diagnosed without reflashing. Each histogram has a single writer task.
+#define HIST_BUCKETS 16  // bucket b covers [2^b, 2^(b+1)) microseconds
+
+struct __attribute__((packed)) LatencyHist {
+  uint32_t buckets[HIST_BUCKETS];
+  uint32_t count;
+  uint32_t max_us;
+  uint64_t total_us;
+};
+
+static LatencyHist g_hist_read;     // i2s_read() block time (capture task)
+static LatencyHist g_hist_convert;  // convert + optional encode (capture task)
+static LatencyHist g_hist_send;     // datagram handoff to lwIP (sender task)
+
+static inline uint32_t cyclesToUs(uint32_t cycles) {
+  uint32_t mhz = getCpuFrequencyMhz();
+  return cycles / (mhz > 0 ? mhz : 1);
+}
+
+static inline void histRecord(LatencyHist& h, uint32_t us) {
+  uint32_t v = us;
+  int b = 0;
+  while (v > 1 && b < HIST_BUCKETS - 1) {
+    v >>= 1;
+    b++;
+  }
+  h.buckets[b]++;
+  h.count++;
+  h.total_us += us;
+  if (us > h.max_us) h.max_us = us;
+}
+
+// Periodic binary stats export (PKT_FLAG_STATS datagram payload).
+struct __attribute__((packed)) StatsPacket {
+  PipelineCounters counters;
+  LatencyHist read_hist;
+  LatencyHist convert_hist;
+  LatencyHist send_hist;
+  uint8_t power_mode;     // POWER_MODE_*
+  int8_t tx_power_q2;     // radio TX power cap, quarter dBm
+  uint8_t tos;            // DSCP/TOS on the audio socket
+  uint8_t pad;
+  uint32_t cpu_mhz;       // clock at sample time (varies under DFS)
+};
+#define STATS_PACKET_EVERY 5  // one stats datagram per 5 serial reports (~10 s)
+
+// Runtime stats verbosity, adjustable over the control channel.
+static uint32_t g_stats_report_ms = STATS_REPORT_MS;
+static bool g_stats_serial = true;  // false: binary stats packets only
 
 static bool g_use_right_channel = DEFAULT_USE_RIGHT_CHANNEL;
 
+// ========= Cross-device clock sync =========
+// TDOA on the server needs left/right frame timestamps on a common timebase,
+// but each node's esp_timer starts at boot and drifts by tens of ppm. Classic
+// two-way exchange over the audio socket: we send a PKT_FLAG_SYNC request
+// carrying t1 (our clock), the server stamps receive (t2) and transmit (t3)
+// and echoes the payload, we stamp arrival (t4). offset = ((t2-t1)+(t3-t4))/2
+// assumes a symmetric path, so only exchanges near the best observed RTT are
+// accepted; between exchanges a slow drift estimate keeps frame timestamps
+// aligned to well under one 16 kHz sample period (~62 us).
+#define SYNC_INTERVAL_MS 1000
+#define SYNC_RTT_ACCEPT_US 5000  // discard exchanges slower than this outright
+#define SYNC_SNAP_US 1000        // step instead of slewing when this far out
+
+struct __attribute__((packed)) SyncPayload {
+  uint64_t t1_device_us;  // device clock when the request was sent
+  uint64_t t2_server_us;  // server clock when the request arrived
+  uint64_t t3_server_us;  // server clock when the reply was sent
+};
+
+static bool g_clock_synced = false;
+static int64_t g_clock_offset_us = 0;      // server clock minus device clock
+static int64_t g_clock_drift_ppb = 0;      // offset change rate
+static uint64_t g_sync_last_local_us = 0;  // device clock at last accepted exchange
+static uint32_t g_sync_best_rtt_us = UINT32_MAX;
+static uint32_t g_sync_exchanges = 0;
+
+// Map a local esp_timer value onto the server timebase. Until the first
+// exchange completes, timestamps stay on the local clock (receivers can tell:
+// boot-relative values are far from the server's).
+static inline uint64_t syncToServerUs(uint64_t local_us) {
+  if (!g_clock_synced) return local_us;
+  int64_t drift = ((int64_t)(local_us - g_sync_last_local_us) * g_clock_drift_ppb) / 1000000000LL;
+  return (uint64_t)((int64_t)local_us + g_clock_offset_us + drift);
+}
+
+static void syncSendRequest() {
+  struct __attribute__((packed)) {
+    PacketHeader hdr;
+    SyncPayload body;
+  } req;
+  memset(&req, 0, sizeof(req));
+  req.hdr.magic = PACKET_MAGIC;
+  req.hdr.version = PACKET_VERSION;
+  req.hdr.flags = PKT_FLAG_SYNC;
+  uint64_t t1 = (uint64_t)esp_timer_get_time();
+  req.hdr.timestamp_us = t1;
+  req.body.t1_device_us = t1;
+  sendFrameBytes((const uint8_t*)&req, sizeof(req));
+}
+
+static void syncHandleReply(const SyncPayload& p, uint64_t t4) {
+  int64_t rtt = (int64_t)(t4 - p.t1_device_us) - (int64_t)(p.t3_server_us - p.t2_server_us);
+  if (rtt < 0 || rtt > SYNC_RTT_ACCEPT_US) return;
+  if ((uint32_t)rtt < g_sync_best_rtt_us) g_sync_best_rtt_us = (uint32_t)rtt;
+  // Queueing delay is asymmetric and lands directly in the offset estimate;
+  // only trust exchanges close to the floor.
+  if ((uint32_t)rtt > g_sync_best_rtt_us * 2 + 200) return;
+
+  int64_t offset = ((int64_t)(p.t2_server_us - p.t1_device_us) +
+                    (int64_t)(p.t3_server_us - t4)) / 2;
+  int64_t delta = offset - g_clock_offset_us;
+  if (delta < 0) delta = -delta;
+  if (!g_clock_synced || delta > SYNC_SNAP_US) {
+    g_clock_offset_us = offset;
+    g_clock_drift_ppb = 0;
+    g_clock_synced = true;
+  } else {
+    int64_t elapsed = (int64_t)(t4 - g_sync_last_local_us);
+    if (elapsed > 0) {
+      int64_t inst_ppb = ((offset - g_clock_offset_us) * 1000000000LL) / elapsed;
+      g_clock_drift_ppb += (inst_ppb - g_clock_drift_ppb) / 8;  // slow EWMA
+    }
+    g_clock_offset_us += (offset - g_clock_offset_us) / 4;  // slew
+  }
+  g_sync_last_local_us = t4;
+  g_sync_exchanges++;
+}
+
+
+static void captureTask(void* arg);
+static void senderTask(void* arg);
+static void statsTask(void* arg);
+static int countNonZero(const int32_t* data, int len);
+
+// ========= 32->16 bit conversion kernel =========
+// Shift, filter, saturate and pack one I2S frame into PCM16. On ESP32-S3
+// targets the shift stage processes 8 samples per iteration with no
+// cross-lane dependencies, the shape the S3's 128-bit PIE datapath (and
+// esp-dsp's fixed-point kernels) wants; the HPF tail is recursive and runs
+// serially over the block. Other targets use the plain scalar loop.
+#ifndef CONVERT_SHIFT
+#define CONVERT_SHIFT 14
+#endif
+
+static inline int16_t sat16(int32_t v) {
+  if (v > INT16_MAX) return INT16_MAX;
+  if (v < INT16_MIN) return INT16_MIN;
+  return (int16_t)v;
+}
+
+// Per-frame statistics fused into the conversion pass so the buffer is only
+// walked once: raw min/max/nonzero feed the mic-health diagnostics, the
+// sum of squares gives per-frame energy (RMS) that the server's direction
+// estimator wants.
+struct FrameStats {
+  int32_t raw_min;
+  int32_t raw_max;
+  int raw_nonzero;
+  uint64_t sum_squares;  // over converted PCM16 samples
+  int32_t peak;          // max |pcm| in the frame
+  int zero_crossings;    // sign changes between consecutive pcm samples
+  int16_t last_pcm;      // previous sample, for the crossing count
+  int sample_count;
+  int16_t pcm_first;     // first converted sample, for the debug report
+};
+
+static FrameStats g_frame_stats;  // last frame, written by the capture task
+
+static inline uint32_t frameRms(const FrameStats& st) {
+  int n = (st.sample_count > 0 ? st.sample_count : 1) * NUM_CHANNELS;
+  return (uint32_t)sqrtf((float)(st.sum_squares / (uint64_t)n));
+}
+
+static inline void statsAccum(FrameStats& st, int32_t raw, int16_t pcm) {
+  if (raw != 0) st.raw_nonzero++;
+  if (raw < st.raw_min) st.raw_min = raw;
+  if (raw > st.raw_max) st.raw_max = raw;
+  st.sum_squares += (uint64_t)((int32_t)pcm * (int32_t)pcm);
+  int32_t ap = pcm < 0 ? -(int32_t)pcm : (int32_t)pcm;
+  if (ap > st.peak) st.peak = ap;
+  if (((int32_t)st.last_pcm ^ (int32_t)pcm) < 0) st.zero_crossings++;
+  st.last_pcm = pcm;
+}
+
+// ========= DC high-pass + optional slow AGC =========
+// Integer port of the retired udp_inmp441_streamer float HPF (y = a*(y' + x - x')) with
+// alpha 0.99 in Q15, fused into the conversion pass so each frame is still
+// walked exactly once. The INMP441's DC offset eats headroom in the
+// >> CONVERT_SHIFT and biases the server's energy-based direction estimate;
+// removing it here fixes both without per-sample float math.
+//
+// AGC is OFF by default and must stay off on direction-sensing nodes: the
+// protocol relies on relative loudness between the left and right mics
+// (docs/ESP32_Protocol.md). When enabled, gain moves one 1/256 step per
+// frame, slow enough to leave the loudness contour of speech intact.
+#ifndef ENABLE_HPF
+#define ENABLE_HPF 1
+#endif
+#define HPF_ALPHA_Q15 32440  // 0.99 * 32768
+#ifndef ENABLE_AGC
+#define ENABLE_AGC 0
+#endif
+#define AGC_TARGET_RMS 4000
+#define AGC_GAIN_MIN_Q8 64    // 0.25x
+#define AGC_GAIN_MAX_Q8 1024  // 4x
+
+struct HpfState {
+  int32_t prev_in;
+  int32_t prev_out;
+};
+
+static HpfState g_hpf[NUM_CHANNELS];
+constexpr bool kStageHpf = ENABLE_HPF != 0;
+constexpr bool kStageAgc = ENABLE_AGC != 0;
+static int32_t g_agc_gain_q8 = 256;  // 1.0x
+
+static inline int32_t hpfStep(HpfState& h, int32_t x) {
+  int32_t y = (int32_t)(((int64_t)HPF_ALPHA_Q15 * (h.prev_out + x - h.prev_in)) >> 15);
+  h.prev_in = x;
+  h.prev_out = y;
+  return y;
+}
+
+// Shared per-sample tail of the conversion kernels: takes the already-shifted
+// value, applies the (recursive) HPF and current AGC gain, saturates. Stage
+// selection is a template parameter, not a runtime flag, so a disabled stage
+// costs nothing in the loop; each build profile instantiates exactly one
+// specialization and LTO inlines it into the kernels.
+template <bool kHpf, bool kAgc>
+static inline int16_t shapeSampleT(int32_t shifted, HpfState& h) {
+  if constexpr (kHpf) {
+    shifted = hpfStep(h, shifted);
+  } else {
+    (void)h;
+  }
+  if constexpr (kAgc) {
+    shifted = (int32_t)(((int64_t)shifted * g_agc_gain_q8) >> 8);
+  }
+  return sat16(shifted);
+}
+
+static inline int16_t shapeSample(int32_t shifted, HpfState& h) {
+  return shapeSampleT<kStageHpf, kStageAgc>(shifted, h);
+}
+
+static inline void agcUpdate(const FrameStats& st) {
+  if constexpr (!kStageAgc) {
+    (void)st;
+    return;
+  }
+  uint32_t rms = frameRms(st);
+  if (rms < 50) return;  // never pump gain on silence
+  if (rms > AGC_TARGET_RMS * 2 && g_agc_gain_q8 > AGC_GAIN_MIN_Q8) {
+    g_agc_gain_q8--;
+  } else if (rms < AGC_TARGET_RMS / 2 && g_agc_gain_q8 < AGC_GAIN_MAX_Q8) {
+    g_agc_gain_q8++;
+  }
+}
+
+#if defined(CONFIG_IDF_TARGET_ESP32S3)
+static void convertFrame(const int32_t* in, int16_t* out, int n, FrameStats& st) {
+  st.raw_min = INT32_MAX;
+  st.raw_max = INT32_MIN;
+  st.raw_nonzero = 0;
+  st.sum_squares = 0;
+  st.peak = 0;
+  st.zero_crossings = 0;
+  st.last_pcm = 0;
+  st.sample_count = n;
+  st.pcm_first = 0;
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    int32_t v[8];
+    v[0] = in[i + 0] >> CONVERT_SHIFT;
+    v[1] = in[i + 1] >> CONVERT_SHIFT;
+    v[2] = in[i + 2] >> CONVERT_SHIFT;
+    v[3] = in[i + 3] >> CONVERT_SHIFT;
+    v[4] = in[i + 4] >> CONVERT_SHIFT;
+    v[5] = in[i + 5] >> CONVERT_SHIFT;
+    v[6] = in[i + 6] >> CONVERT_SHIFT;
+    v[7] = in[i + 7] >> CONVERT_SHIFT;
+    for (int k = 0; k < 8; k++) {
+      out[i + k] = shapeSample(v[k], g_hpf[0]);
+      statsAccum(st, in[i + k], out[i + k]);
+    }
+  }
+  for (; i < n; i++) {
+    out[i] = shapeSample(in[i] >> CONVERT_SHIFT, g_hpf[0]);
+    statsAccum(st, in[i], out[i]);
+  }
+  if (n > 0) st.pcm_first = out[0];
+  agcUpdate(st);
+}
+#else
+static void convertFrame(const int32_t* in, int16_t* out, int n, FrameStats& st) {
+  st.raw_min = INT32_MAX;
+  st.raw_max = INT32_MIN;
+  st.raw_nonzero = 0;
+  st.sum_squares = 0;
+  st.peak = 0;
+  st.zero_crossings = 0;
+  st.last_pcm = 0;
+  st.sample_count = n;
+  st.pcm_first = 0;
+  for (int i = 0; i < n; i++) {
+    out[i] = shapeSample(in[i] >> CONVERT_SHIFT, g_hpf[0]);
+    statsAccum(st, in[i], out[i]);
+  }
+  if (n > 0) st.pcm_first = out[0];
+  agcUpdate(st);
+}
+#endif
+
+#if !DUAL_MIC
+// 24-bit variant: pack the INMP441's full native resolution as 3-byte
+// little-endian samples (1.5x the PCM16 bandwidth instead of 2x for raw
+// 32-bit words) and leave the shift/scaling decision to the server. Quiet
+// far-field speech lives exactly in the bits the >>14 path discards. The
+// HPF runs in the 24-bit domain; AGC never touches this path - preserving
+// resolution is its whole point. Stats accumulate over the s16 projection
+// so RMS/VAD thresholds mean the same thing in every mode.
+static void convertFrame24(const int32_t* in, uint8_t* out, int n, FrameStats& st) {
+  st.raw_min = INT32_MAX;
+  st.raw_max = INT32_MIN;
+  st.raw_nonzero = 0;
+  st.sum_squares = 0;
+  st.peak = 0;
+  st.zero_crossings = 0;
+  st.last_pcm = 0;
+  st.sample_count = n;
+  st.pcm_first = 0;
+  for (int i = 0; i < n; i++) {
+    int32_t v = in[i] >> 8;  // 24 significant bits, sign preserved
+#if ENABLE_HPF
+    v = hpfStep(g_hpf[0], v);
+#endif
+    if (v > 8388607) v = 8388607;
+    if (v < -8388608) v = -8388608;
+    out[i * 3 + 0] = (uint8_t)(v & 0xff);
+    out[i * 3 + 1] = (uint8_t)((v >> 8) & 0xff);
+    out[i * 3 + 2] = (uint8_t)((v >> 16) & 0xff);
+    int16_t pcm = sat16(v >> 8);
+    if (i == 0) st.pcm_first = pcm;
+    statsAccum(st, in[i], pcm);
+  }
+}
+#endif
+
+#if DUAL_MIC
+// Dual-mic variant: shift/saturate both controllers' buffers and interleave
+// L/R into the wire payload in one pass. Stats span both channels, so the
+// stuck-at-zero detector still fires if both buses go quiet.
+static void convertFrameStereo(const int32_t* in_l, const int32_t* in_r, int16_t* out, int n, FrameStats& st) {
+  st.raw_min = INT32_MAX;
+  st.raw_max = INT32_MIN;
+  st.raw_nonzero = 0;
+  st.sum_squares = 0;
+  st.peak = 0;
+  st.zero_crossings = 0;
+  st.last_pcm = 0;
+  st.sample_count = n;
+  st.pcm_first = 0;
+  for (int i = 0; i < n; i++) {
+    int16_t l = shapeSample(in_l[i] >> CONVERT_SHIFT, g_hpf[0]);
+    int16_t r = shapeSample(in_r[i] >> CONVERT_SHIFT, g_hpf[1]);
+    out[i * 2] = l;
+    out[i * 2 + 1] = r;
+    statsAccum(st, in_l[i], l);
+    statsAccum(st, in_r[i], r);
+  }
+  if (n > 0) st.pcm_first = out[0];
+  agcUpdate(st);
+}
+#endif
+
+// ========= Energy gate (VAD) =========
+// Mic nodes spend most of the day streaming silence. With the gate enabled,
+// frames whose fused RMS stays below the threshold (after a hangover so we
+// don't clip word tails) are sent as header-only keepalives carrying the RMS
+// in the reserved field, instead of a full PCM payload. The server already
+// tolerates gaps (it handles device disconnects). Off by default because the
+// protocol doc asks for continuous streaming unless the deployment opts in.
+static bool g_vad_enabled = false;
+static uint32_t g_vad_threshold_rms = 200;   // PCM16 RMS units
+static uint32_t g_vad_hangover_frames = 25;  // ~800 ms at 512-sample frames
+
+// ========= IMA-ADPCM encoder =========
+// Optional 4-bit IMA-ADPCM compression between the conversion kernel and the
+// sender: halves-again the uplink (~64 kbit/s at 16 kHz mono vs 256 for PCM)
+// for nodes on weak links. Runtime-selectable per node (g_adpcm_enabled; flip
+// it via provisioning/control). Each packet carries the encoder state in a
+// 4-byte preamble so every datagram decodes independently after loss.
+// Mono only: stereo interleave would wreck the predictor, so DUAL_MIC frames
+// are always sent as PCM.
+static bool g_adpcm_enabled = false;
+
+// 24-bit packed transmission (PCM_FMT_S24), control-selectable. Mutually
+// exclusive with the 16-bit-based ADPCM and decimation stages; when ADPCM
+// is also enabled it wins and the stream stays 16-bit.
+static bool g_pcm24_enabled = false;
+
+struct __attribute__((packed)) AdpcmState {
+  int16_t predictor;
+  uint8_t step_index;
+  uint8_t reserved;
+};
+
+static const int16_t kAdpcmStepTable[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+  11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+  32767
+};
+
+static const int8_t kAdpcmIndexTable[16] = {
+  -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static AdpcmState g_adpcm_state = {0, 0, 0};
+
+static inline uint8_t adpcmEncodeSample(AdpcmState& st, int16_t sample) {
+  int step = kAdpcmStepTable[st.step_index];
+  int diff = (int)sample - (int)st.predictor;
+  uint8_t nibble = 0;
+  if (diff < 0) {
+    nibble = 8;
+    diff = -diff;
+  }
+  int delta = step >> 3;
+  if (diff >= step) { nibble |= 4; diff -= step; delta += step; }
+  step >>= 1;
+  if (diff >= step) { nibble |= 2; diff -= step; delta += step; }
+  step >>= 1;
+  if (diff >= step) { nibble |= 1; delta += step; }
+  st.predictor = sat16((int32_t)st.predictor + ((nibble & 8) ? -delta : delta));
+  int idx = st.step_index + kAdpcmIndexTable[nibble];
+  if (idx < 0) idx = 0;
+  if (idx > 88) idx = 88;
+  st.step_index = (uint8_t)idx;
+  return nibble;
+}
+
+// Encode n samples (n rounded down to even) into out: 4-byte state preamble
+// followed by packed nibbles, low nibble first. Returns bytes written.
+static size_t adpcmEncodeFrame(const int16_t* pcm, int n, uint8_t* out) {
+  AdpcmState* preamble = (AdpcmState*)out;
+  *preamble = g_adpcm_state;  // decoder state at frame start
+  uint8_t* data = out + sizeof(AdpcmState);
+  n &= ~1;
+  for (int i = 0; i < n; i += 2) {
+    uint8_t lo = adpcmEncodeSample(g_adpcm_state, pcm[i]);
+    uint8_t hi = adpcmEncodeSample(g_adpcm_state, pcm[i + 1]);
+    data[i / 2] = (uint8_t)(lo | (hi << 4));
+  }
+  return sizeof(AdpcmState) + (size_t)(n / 2);
+}
+
+// ========= Half-rate decimation =========
+// 2:1 decimator for the low-bandwidth mode (8 kHz at the default profile):
+// ambient-sensing nodes don't need 16 kHz for energy/direction or the
+// danger-sound classifier, and half the rate is half the airtime and half
+// the downstream processing. A 7-tap Q15 halfband FIR (-1/32, 0, 9/32, 1/2,
+// 9/32, 0, -1/32) folds the upper band well down instead of aliasing it
+// into speech the way dropping every other sample would; the zero taps and
+// symmetry make each output four multiplies. Runs in place on the converted
+// frame with the tail of the previous frame as filter history, so frame
+// boundaries are seamless. Selectable per node over the control channel and
+// engaged automatically by the degradation ladder; marked on the wire with
+// PKT_FLAG_HALF_RATE. Mono only, like the ADPCM stage.
+#define HB_TAPS 7
+static const int32_t kHalfbandQ15[HB_TAPS] = {-1024, 0, 9216, 16384, 9216, 0, -1024};
+
+static int decimateBy2(int16_t* pcm, int n) {
+  static int16_t hist[HB_TAPS - 1];  // input tail carried across frames
+  int16_t head[HB_TAPS - 1];         // low input samples before they're overwritten
+  memcpy(head, pcm, sizeof(head));
+  int out = n / 2;
+  for (int k = 0; k < out; k++) {
+    int32_t acc = 0;
+    for (int j = 0; j < HB_TAPS; j++) {
+      if (kHalfbandQ15[j] == 0) continue;  // constant-folded away
+      int idx = 2 * k + j - (HB_TAPS - 1);
+      int32_t x;
+      if (idx < 0) {
+        x = hist[idx + HB_TAPS - 1];
+      } else if (idx < HB_TAPS - 1) {
+        x = head[idx];
+      } else {
+        x = pcm[idx];
+      }
+      acc += kHalfbandQ15[j] * x;
+    }
+    pcm[k] = sat16(acc >> 15);
+  }
+  // The input tail is untouched by the in-place writes (out <= n - HB_TAPS + 1
+  // for every frame size the profile can produce).
+  memcpy(hist, &pcm[n - (HB_TAPS - 1)], sizeof(hist));
+  return out;
+}
+
+static bool g_decimate_half = false;
+
+// ========= Adaptive degradation ladder =========
+// When the link sours, stepping down gracefully beats blasting full-rate
+// PCM into a dying connection - 8 kHz subtitles beat 16 kHz silence. Levels
+// stack: 0 operator baseline, 1 ADPCM, 2 +max batching, 3 +half-rate
+// decimation, 4 keepalives only. ADPCM goes before batching because the
+// sender's byte budget (BATCH_MAX_BYTES) makes batching a no-op at
+// full-size PCM16 chunks: only once compression shrinks the chunks can
+// several share a datagram, so this order cuts bitrate on the first rung
+// and packet rate on the second instead of requesting a coalesce the
+// sender would refuse. The stats task scores each report window
+// on local send failures and server-reported loss (control cmd 10) and
+// moves one rung at a time. While above level 0 the ladder owns the
+// batching/compression knobs; the operator's values come back on full
+// recovery.
+#define LADDER_MAX_LEVEL 4
+#define LADDER_DOWN_PCT 10   // window failure % that forces a step down
+#define LADDER_UP_WINDOWS 3  // consecutive clean windows per step back up
+
+static bool g_ladder_enabled = true;
+static int g_ladder_level = 0;
+static bool g_keepalive_only = false;
+static uint32_t g_srv_loss_permille = 0;  // latest server-reported loss
+
+static void ladderApply(int level) {
+  static uint32_t base_batch = 0;
+  static bool base_adpcm = false;
+  static bool base_half = false;
+  static bool have_base = false;
+  if (level > 0 && !have_base) {
+    base_batch = g_batch_frames;
+    base_adpcm = g_adpcm_enabled;
+    base_half = g_decimate_half;
+    have_base = true;
+  }
+  g_adpcm_enabled = (level >= 1) ? (NUM_CHANNELS == 1) : (have_base && base_adpcm);
+  g_batch_frames = (level >= 2) ? BATCH_MAX_FRAMES : (have_base ? base_batch : g_batch_frames);
+  g_decimate_half = ((level >= 3) || (have_base && base_half)) && (NUM_CHANNELS == 1);
+  g_keepalive_only = (level >= 4);
+  if (level == 0) have_base = false;
+  g_ladder_level = level;
+}
+
+static void ladderEvaluate(uint32_t window_sent, uint32_t window_failed) {
+  static int clean_windows = 0;
+  uint32_t total = window_sent + window_failed;
+  uint32_t fail_pct = total ? (window_failed * 100) / total : 0;
+  uint32_t srv_pct = g_srv_loss_permille / 10;
+  uint32_t worst = (fail_pct > srv_pct) ? fail_pct : srv_pct;
+  g_srv_loss_permille /= 2;  // decay stale reports between updates
+
+  if (worst >= LADDER_DOWN_PCT) {
+    clean_windows = 0;
+    if (g_ladder_level < LADDER_MAX_LEVEL) {
+      ladderApply(g_ladder_level + 1);
+      Serial.printf("Ladder: %lu%% loss, stepping down to level %d\n",
+                    (unsigned long)worst, g_ladder_level);
+    }
+  } else if (worst <= 1 && g_ladder_level > 0) {
+    if (++clean_windows >= LADDER_UP_WINDOWS) {
+      clean_windows = 0;
+      ladderApply(g_ladder_level - 1);
+      Serial.printf("Ladder: link clean, stepping up to level %d\n", g_ladder_level);
+    }
+  } else {
+    clean_windows = 0;
+  }
+}
+
+// ========= Network benchmark =========
+// On-demand soak test (CTRL_BENCHMARK): generate synthetic frames and ramp
+// the packet rate until lwIP starts refusing datagrams, reporting achieved
+// throughput, failure rate and send-latency per step. Lets us qualify an
+// AP/placement before the demo instead of discovering a bad RF spot when
+// subtitles glitch live. Capture keeps draining DMA during the run but does
+// not enqueue frames, so the benchmark owns the socket.
+#define BENCH_START_PPS 100
+#define BENCH_STEP_MS 2000
+#define BENCH_FAIL_STOP_PCT 2  // ramp stops when a step fails more than this
+
+static volatile uint32_t g_bench_seconds = 0;  // nonzero: run requested
+static volatile uint16_t g_bench_payload = 0;  // payload bytes, 0 = current frame size
+static volatile bool g_bench_active = false;
+
+static void benchRun(uint32_t seconds, uint16_t payload_bytes) {
+  static struct __attribute__((packed)) {
+    PacketHeader hdr;
+    uint8_t payload[BUFFER_SIZE * NUM_CHANNELS * 2];
+  } pkt;
+  if (payload_bytes == 0 || payload_bytes > sizeof(pkt.payload)) {
+    payload_bytes = (uint16_t)(g_samples_per_frame * NUM_CHANNELS * 2);
+  }
+  memset(&pkt.hdr, 0, sizeof(pkt.hdr));
+  pkt.hdr.magic = PACKET_MAGIC;
+  pkt.hdr.version = PACKET_VERSION;
+  pkt.hdr.flags = PKT_FLAG_BENCH;
+  for (uint16_t i = 0; i < payload_bytes; i++) pkt.payload[i] = (uint8_t)(i * 7);
+
+  Serial.printf("Benchmark: %lu s soak, %u byte payloads, ramp from %d pkt/s\n",
+                (unsigned long)seconds, (unsigned)payload_bytes, BENCH_START_PPS);
+  g_bench_active = true;
+  uint32_t pps = BENCH_START_PPS;
+  uint32_t best_pps = 0;
+  uint32_t best_kbps = 0;
+  uint32_t seq = 0;
+  uint64_t deadline = (uint64_t)esp_timer_get_time() + (uint64_t)seconds * 1000000ULL;
+
+  while ((uint64_t)esp_timer_get_time() < deadline) {
+    // This runs inline in the loop task, which sits on the 15 s task WDT; a
+    // soak longer than that must keep feeding it between ramp steps.
+    esp_task_wdt_reset();
+    LatencyHist hist;
+    memset(&hist, 0, sizeof(hist));
+    uint32_t sent = 0, failed = 0;
+    uint64_t interval_us = 1000000ULL / pps;
+    uint64_t next_us = (uint64_t)esp_timer_get_time();
+    uint64_t step_end = next_us + (uint64_t)BENCH_STEP_MS * 1000ULL;
+
+    while ((uint64_t)esp_timer_get_time() < step_end) {
+      int64_t wait = (int64_t)(next_us - (uint64_t)esp_timer_get_time());
+      if (wait > 2000) vTaskDelay(pdMS_TO_TICKS((uint32_t)(wait / 1000)));
+      while ((int64_t)(next_us - (uint64_t)esp_timer_get_time()) > 0) {
+      }
+      pkt.hdr.seq = seq++;
+      pkt.hdr.timestamp_us = syncToServerUs((uint64_t)esp_timer_get_time());
+      uint32_t c0 = esp_cpu_get_cycle_count();
+      bool ok = sendFrameBytes((const uint8_t*)&pkt, sizeof(PacketHeader) + payload_bytes);
+      histRecord(hist, cyclesToUs(esp_cpu_get_cycle_count() - c0));
+      if (ok) sent++; else failed++;
+      next_us += interval_us;
+    }
+
+    uint32_t total = sent + failed;
+    uint32_t fail_pct = total ? (failed * 100) / total : 0;
+    uint32_t kbps = (uint32_t)(((uint64_t)sent * (sizeof(PacketHeader) + payload_bytes) * 8ULL) / BENCH_STEP_MS);
+    Serial.printf("  bench: target=%lu pkt/s sent=%lu failed=%lu (%lu%%) ~%lu kbit/s send avg=%lu us max=%lu us\n",
+                  (unsigned long)pps, (unsigned long)sent, (unsigned long)failed,
+                  (unsigned long)fail_pct, (unsigned long)kbps,
+                  (unsigned long)(hist.count ? hist.total_us / hist.count : 0),
+                  (unsigned long)hist.max_us);
+    if (fail_pct > BENCH_FAIL_STOP_PCT) {
+      Serial.printf("  bench: failure rate above %d%%, stopping ramp\n", BENCH_FAIL_STOP_PCT);
+      break;
+    }
+    best_pps = pps;
+    best_kbps = kbps;
+    pps += pps / 2;
+  }
+
+  Serial.printf("Benchmark done: sustained ~%lu pkt/s (~%lu kbit/s) at <=%d%% send failures\n",
+                (unsigned long)best_pps, (unsigned long)best_kbps, BENCH_FAIL_STOP_PCT);
+  g_bench_active = false;
+}
+
+// ========= Control channel =========
+// Server->device config commands over the same connected socket the audio
+// leaves on (no second port to provision). Every runtime knob the server
+// cares about is adjustable live - no I2S reinstall, no reboot, the stream
+// keeps flowing. Auth is a shared 32-bit token plus a strictly increasing
+// sequence number as a replay guard: hackathon-grade, like the Wi-Fi
+// credentials above. Applied commands are echoed back with the high bit of
+// cmd set as an ack.
+#define CONTROL_TOKEN 0x48554447  // "HUDG"; rebuild to rotate
+
+#define CTRL_SET_DEST 1         // value = IPv4 (network order), aux = port
+#define CTRL_SET_SAMPLE_RATE 2  // value = Hz, applied via i2s_set_clk
+#define CTRL_SET_COMPRESSION 3  // value = 0 PCM, 1 ADPCM
+#define CTRL_SET_VAD 4          // value = RMS threshold, 0 disables the gate
+#define CTRL_SET_BATCH 5        // value = frames per datagram (1..BATCH_MAX_FRAMES)
+#define CTRL_SET_STATS 6        // value = serial report period ms, 0 = binary only
+#define CTRL_BENCHMARK 7        // value = soak seconds (1..60), aux = payload bytes
+#define CTRL_ADD_SINK 8         // value = IPv4 (network order), aux = port
+#define CTRL_CLEAR_SINKS 9      // drop all extra sinks
+#define CTRL_REPORT_LOSS 10     // value = server-observed loss, per mille
+#define CTRL_SET_LADDER 11      // value = 0/1 enable the degradation ladder
+#define CTRL_SET_HALF_RATE 12   // value = 0/1 half-rate (decimated) output
+#define CTRL_SET_PCM24 13       // value = 0/1 packed 24-bit payloads
+#define CTRL_SET_POWER 14       // value = 0 performance, 1 battery (DFS+sleep)
+#define CTRL_SET_WIFI_TX 15     // value = TX power (quarter dBm, 8..84), aux = TOS byte
+#define CTRL_PIN_FAILOVER 16     // probe the warm-standby pin map and cut over if it has signal
+
+struct __attribute__((packed)) ControlPayload {
+  uint32_t token;
+  uint32_t ctrl_seq;  // must strictly increase; stale/replayed commands dropped
+  uint8_t cmd;
+  uint8_t status;     // reply only: 1 applied, 0 rejected
+  uint16_t aux;
+  uint32_t value;
+};
+
+static uint32_t g_ctrl_last_seq = 0;
+
+// Apply one authenticated command. Returns true if it took effect.
+static bool controlApply(const ControlPayload& c) {
+  switch (c.cmd) {
+    case CTRL_SET_DEST: {
+      if (c.aux == 0) return false;
+      uint32_t ip = c.value;
+      snprintf(g_dest_addr, sizeof(g_dest_addr), "%u.%u.%u.%u",
+               (unsigned)(ip & 0xff), (unsigned)((ip >> 8) & 0xff),
+               (unsigned)((ip >> 16) & 0xff), (unsigned)((ip >> 24) & 0xff));
+      g_dest_port = c.aux;
+      g_prefs.begin("net", false);
+      g_prefs.putString("addr", g_dest_addr);
+      g_prefs.putUShort("port", g_dest_port);
+      g_prefs.end();
+#if USE_LWIP_UDP
+      // Reconnect the socket; the capture ring absorbs the gap.
+      if (g_udp_sock >= 0) {
+        close(g_udp_sock);
+        g_udp_sock = -1;
+      }
+      udpTransportInit();
+#endif
+      Serial.printf("Control: retargeted stream to %s:%u\n", g_dest_addr, (unsigned)g_dest_port);
+      return true;
+    }
+    case CTRL_SET_SAMPLE_RATE: {
+      if (c.value < 8000 || c.value > 48000) return false;
+      g_profile.sample_rate = c.value;
+      g_samples_per_frame = (int)((g_profile.sample_rate * g_profile.frame_ms) / 1000);
+      if (g_samples_per_frame > BUFFER_SIZE) g_samples_per_frame = BUFFER_SIZE;
+      // i2s_set_clk retunes the running driver; no uninstall/reinstall.
+      i2s_set_clk(I2S_NUM_0, g_profile.sample_rate, I2S_BITS_PER_SAMPLE_32BIT,
+                  DUAL_MIC ? I2S_CHANNEL_MONO : I2S_CHANNEL_STEREO);
+#if DUAL_MIC
+      i2s_set_clk(I2S_NUM_1, g_profile.sample_rate, I2S_BITS_PER_SAMPLE_32BIT, I2S_CHANNEL_MONO);
+      // Sequential retunes restart the two DMAs out of step; realign them
+      // the same way setupI2S does or the inter-channel skew comes back.
+      i2s_stop(I2S_NUM_0);
+      i2s_stop(I2S_NUM_1);
+      i2s_zero_dma_buffer(I2S_NUM_0);
+      i2s_zero_dma_buffer(I2S_NUM_1);
+      i2s_start(I2S_NUM_0);
+      i2s_start(I2S_NUM_1);
+#else
+      // Keep the warm standby clocked identically so a later cutover is clean.
+      if (g_standby_installed) {
+        i2s_set_clk(I2S_NUM_1, g_profile.sample_rate, I2S_BITS_PER_SAMPLE_32BIT, I2S_CHANNEL_STEREO);
+      }
+#endif
+      g_prefs.begin("audio", false);
+      g_prefs.putUInt("rate", g_profile.sample_rate);
+      g_prefs.end();
+      Serial.printf("Control: sample rate now %lu Hz (%d samples/frame)\n",
+                    (unsigned long)g_profile.sample_rate, g_samples_per_frame);
+      return true;
+    }
+    case CTRL_SET_COMPRESSION:
+#if DUAL_MIC
+      if (c.value != 0) return false;  // ADPCM encoder is mono-only
+#endif
+      if (c.value > 1) return false;
+      g_adpcm_enabled = (c.value == 1);
+      return true;
+    case CTRL_SET_VAD:
+      g_vad_enabled = (c.value != 0);
+      if (c.value != 0) g_vad_threshold_rms = c.value;
+      return true;
+    case CTRL_SET_BATCH:
+      if (c.value < 1 || c.value > BATCH_MAX_FRAMES) return false;
+      g_batch_frames = c.value;
+      return true;
+    case CTRL_SET_STATS:
+      g_stats_serial = (c.value != 0);
+      if (c.value >= 500 && c.value <= 60000) g_stats_report_ms = c.value;
+      return true;
+    case CTRL_BENCHMARK:
+      if (c.value < 1 || c.value > 60) return false;
+      g_bench_payload = c.aux;
+      g_bench_seconds = c.value;  // picked up by loop()
+      return true;
+    case CTRL_ADD_SINK: {
+#if USE_LWIP_UDP && !USE_WEBSOCKET
+      if (c.aux == 0 || g_extra_sink_count >= MAX_EXTRA_SINKS) return false;
+      if (g_fanout_sock < 0) {
+        g_fanout_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (g_fanout_sock < 0) return false;
+      }
+      UdpSink& s = g_extra_sinks[g_extra_sink_count];
+      memset(&s, 0, sizeof(s));
+      s.addr.sin_family = AF_INET;
+      s.addr.sin_port = htons(c.aux);
+      s.addr.sin_addr.s_addr = c.value;
+      s.ip = c.value;
+      s.port = c.aux;
+      g_extra_sink_count++;
+      Serial.printf("Control: fanout sink %u.%u.%u.%u:%u added (%d extra)\n",
+                    (unsigned)(s.ip & 0xff), (unsigned)((s.ip >> 8) & 0xff),
+                    (unsigned)((s.ip >> 16) & 0xff), (unsigned)((s.ip >> 24) & 0xff),
+                    (unsigned)s.port, g_extra_sink_count);
+      return true;
+#else
+      return false;
+#endif
+    }
+    case CTRL_CLEAR_SINKS:
+      g_extra_sink_count = 0;
+      return true;
+    case CTRL_REPORT_LOSS:
+      if (c.value > 1000) return false;
+      g_srv_loss_permille = c.value;
+      return true;
+    case CTRL_SET_LADDER:
+      g_ladder_enabled = (c.value != 0);
+      if (!g_ladder_enabled && g_ladder_level != 0) ladderApply(0);
+      return true;
+    case CTRL_SET_HALF_RATE:
+#if DUAL_MIC
+      if (c.value != 0) return false;  // decimator is mono-only
+#endif
+      if (c.value > 1) return false;
+      g_decimate_half = (c.value == 1);
+      return true;
+    case CTRL_SET_PCM24:
+#if DUAL_MIC
+      if (c.value != 0) return false;  // 24-bit packing is mono-only
+#endif
+      if (c.value > 1) return false;
+      g_pcm24_enabled = (c.value == 1);
+      return true;
+    case CTRL_SET_POWER:
+      if (c.value > 1) return false;
+      if (!powerApply((uint8_t)c.value)) return false;
+      g_prefs.begin("power", false);
+      g_prefs.putUChar("mode", g_power_mode);
+      g_prefs.end();
+      return true;
+    case CTRL_SET_WIFI_TX:
+      if (c.value < 8 || c.value > 84) return false;
+      g_wifi_tx.max_tx_power_q2 = (int8_t)c.value;
+      g_wifi_tx.tos = (uint8_t)(c.aux & 0xff);
+      wifiTxApplyRadio();
+      wifiTxApplySocket(g_udp_sock);
+      g_prefs.begin("wifitx", false);
+      g_prefs.putChar("pwr", g_wifi_tx.max_tx_power_q2);
+      g_prefs.putUChar("tos", g_wifi_tx.tos);
+      g_prefs.end();
+      return true;
+    case CTRL_PIN_FAILOVER:
+#if DUAL_MIC
+      return false;  // both controllers already carry live mics
+#else
+      if (!g_standby_installed) return false;
+      g_standby_probe = true;  // capture task probes and cuts over between frames
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+static void controlHandle(ControlPayload c) {
+  if (c.token != CONTROL_TOKEN) return;  // silently drop unauthenticated
+  if (c.ctrl_seq <= g_ctrl_last_seq) return;
+  g_ctrl_last_seq = c.ctrl_seq;
+  bool ok = controlApply(c);
+
+  struct __attribute__((packed)) {
+    PacketHeader hdr;
+    ControlPayload body;
+  } ack;
+  memset(&ack, 0, sizeof(ack));
+  ack.hdr.magic = PACKET_MAGIC;
+  ack.hdr.version = PACKET_VERSION;
+  ack.hdr.flags = PKT_FLAG_CONTROL;
+  ack.hdr.timestamp_us = syncToServerUs((uint64_t)esp_timer_get_time());
+  ack.body = c;
+  ack.body.token = 0;  // never echo the token
+  ack.body.cmd = c.cmd | 0x80;
+  ack.body.status = ok ? 1 : 0;
+  sendFrameBytes((const uint8_t*)&ack, sizeof(ack));
+}
+
+// Drain pending server->device datagrams (sync replies and control commands;
+// the socket is connected, so only the server can reach it). Called from
+// loop(); nothing in the audio path.
+static void serverPoll() {
+#if USE_LWIP_UDP
+  if (g_udp_sock < 0) return;
+  uint8_t buf[sizeof(PacketHeader) + 32];
+  int n;
+  while ((n = recv(g_udp_sock, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+    uint64_t t4 = (uint64_t)esp_timer_get_time();
+    if (n < (int)sizeof(PacketHeader)) continue;
+    const PacketHeader* hdr = (const PacketHeader*)buf;
+    if (hdr->magic != PACKET_MAGIC) continue;
+    if ((hdr->flags & PKT_FLAG_SYNC) && n >= (int)(sizeof(PacketHeader) + sizeof(SyncPayload))) {
+      SyncPayload p;
+      memcpy(&p, buf + sizeof(PacketHeader), sizeof(p));
+      syncHandleReply(p, t4);
+    } else if ((hdr->flags & PKT_FLAG_CONTROL) && n >= (int)(sizeof(PacketHeader) + sizeof(ControlPayload))) {
+      ControlPayload c;
+      memcpy(&c, buf + sizeof(PacketHeader), sizeof(c));
+      controlHandle(c);
+    }
+  }
+#endif
+}
+
+// Boot-time stream destination: NVS override (set via CTRL_SET_DEST) wins
+// over the compile-time default.
+static void loadNetDest() {
+  snprintf(g_dest_addr, sizeof(g_dest_addr), "%s", udpAddress);
+  g_dest_port = (uint16_t)udpPort;
+  g_prefs.begin("net", true);
+  String addr = g_prefs.getString("addr", "");
+  uint16_t port = g_prefs.getUShort("port", 0);
+  g_prefs.end();
+  if (addr.length() > 0 && port != 0) {
+    snprintf(g_dest_addr, sizeof(g_dest_addr), "%s", addr.c_str());
+    g_dest_port = port;
+  }
+}
+
+// Read the boot profile from NVS and derive frame sizing, clamped so a bad
+// value can never overrun the statically sized buffers.
+static void loadAudioProfile() {
+  g_prefs.begin("audio", true);
+  g_profile.sample_rate = g_prefs.getUInt("rate", g_profile.sample_rate);
+  g_profile.frame_ms = g_prefs.getUShort("frameMs", g_profile.frame_ms);
+  g_profile.dma_buf_count = g_prefs.getUChar("dma", g_profile.dma_buf_count);
+  g_prefs.end();
+
+  if (g_profile.sample_rate < 8000) g_profile.sample_rate = 8000;
+  if (g_profile.sample_rate > 48000) g_profile.sample_rate = 48000;
+  if (g_profile.frame_ms < 5) g_profile.frame_ms = 5;
+  if (g_profile.dma_buf_count < 2) g_profile.dma_buf_count = 2;
+  if (g_profile.dma_buf_count > 16) g_profile.dma_buf_count = 16;
+
+  g_samples_per_frame = (int)((g_profile.sample_rate * g_profile.frame_ms) / 1000);
+  if (g_samples_per_frame > BUFFER_SIZE) {
+    g_samples_per_frame = BUFFER_SIZE;
+    g_profile.frame_ms = (uint16_t)((BUFFER_SIZE * 1000) / g_profile.sample_rate);
+  }
+
+  Serial.printf("Audio profile: %luHz %ums (%d samples), dma_buf_count=%u\n",
+                (unsigned long)g_profile.sample_rate, (unsigned)g_profile.frame_ms,
+                g_samples_per_frame, (unsigned)g_profile.dma_buf_count);
+}
+
 static void setupI2S(bool use_right_channel) {
   i2s_config_t i2s_config = {
     .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX),
-    .sample_rate = SAMPLE_RATE,
+    .sample_rate = g_profile.sample_rate,
     .bits_per_sample = I2S_BITS_PER_SAMPLE_32BIT,
+#if DUAL_MIC
     .channel_format = use_right_channel ? I2S_CHANNEL_FMT_ONLY_RIGHT : I2S_CHANNEL_FMT_ONLY_LEFT,
+#else
+    // Capture both slots; the capture task deinterleaves the live one.
+    .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
+#endif
     .communication_format = I2S_COMM_FORMAT_I2S,
     .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-    .dma_buf_count = 8,
-    .dma_buf_len = BUFFER_SIZE,
+    .dma_buf_count = g_profile.dma_buf_count,
+    .dma_buf_len = g_samples_per_frame,
     .use_apll = false,
     .tx_desc_auto_clear = false,
     .fixed_mclk = 0
@@ -89,24 +1835,126 @@ static void setupI2S(bool use_right_channel) {
     Serial.println(err);
   }
 
-  err = i2s_set_clk(I2S_NUM_0, SAMPLE_RATE, I2S_BITS_PER_SAMPLE_32BIT, I2S_CHANNEL_MONO);
+  err = i2s_set_clk(I2S_NUM_0, g_profile.sample_rate, I2S_BITS_PER_SAMPLE_32BIT,
+                    DUAL_MIC ? I2S_CHANNEL_MONO : I2S_CHANNEL_STEREO);
   if (err != ESP_OK) {
     Serial.print("ERROR: i2s_set_clk failed: ");
     Serial.println(err);
   }
 
   i2s_zero_dma_buffer(I2S_NUM_0);
-  
+
+#if DUAL_MIC
+  // Second mic on the other controller. Each mic sits alone on its bus with
+  // L/R strapped the same way, so the channel format matches mic 0.
+  i2s_pin_config_t pin_config2 = {
+    .bck_io_num = I2S1_SCK,
+    .ws_io_num = I2S1_WS,
+    .data_out_num = I2S_PIN_NO_CHANGE,
+    .data_in_num = I2S1_SD
+  };
+
+  err = i2s_driver_install(I2S_NUM_1, &i2s_config, 0, NULL);
+  if (err != ESP_OK) {
+    Serial.print("ERROR: i2s_driver_install (mic 1) failed: ");
+    Serial.println(err);
+  }
+
+  err = i2s_set_pin(I2S_NUM_1, &pin_config2);
+  if (err != ESP_OK) {
+    Serial.print("ERROR: i2s_set_pin (mic 1) failed: ");
+    Serial.println(err);
+  }
+
+  err = i2s_set_clk(I2S_NUM_1, g_profile.sample_rate, I2S_BITS_PER_SAMPLE_32BIT, I2S_CHANNEL_MONO);
+  if (err != ESP_OK) {
+    Serial.print("ERROR: i2s_set_clk (mic 1) failed: ");
+    Serial.println(err);
+  }
+
+  i2s_zero_dma_buffer(I2S_NUM_1);
+
+  // i2s_driver_install starts each controller as it lands, so the two DMAs
+  // began filling a whole driver-install apart - tens to hundreds of samples
+  // of constant inter-channel skew, which is fatal for TDOA (<1 sample
+  // needed). Quiesce both, discard whatever the gap captured, then start
+  // them back-to-back: the two restarts are adjacent register writes, so
+  // the residual start skew is a few microseconds, well under one 62.5 us
+  // sample period at 16 kHz. The shared APB source keeps them
+  // frequency-locked from there; any remaining sub-sample offset is
+  // constant but unmeasured.
+  i2s_stop(I2S_NUM_0);
+  i2s_stop(I2S_NUM_1);
+  i2s_zero_dma_buffer(I2S_NUM_0);
+  i2s_zero_dma_buffer(I2S_NUM_1);
+  i2s_start(I2S_NUM_0);
+  i2s_start(I2S_NUM_1);
+#endif
+
   Serial.print("I2S initialized - Channel: ");
-  Serial.println(use_right_channel ? "RIGHT" : "LEFT");
+  Serial.print(use_right_channel ? "RIGHT" : "LEFT");
+  Serial.println(DUAL_MIC ? " (dual mic, interleaved L/R)" : "");
 }
 
 static void reinitI2S(bool use_right_channel) {
   i2s_driver_uninstall(I2S_NUM_0);
+#if DUAL_MIC
+  i2s_driver_uninstall(I2S_NUM_1);
+#endif
   delay(20);
   setupI2S(use_right_channel);
 }
 
+#if !DUAL_MIC
+// Pre-stage the alternate pin map on the idle second controller. Same config
+// as the active bus (stereo-slot capture, boot profile clocking) so a cutover
+// changes nothing downstream except which port the capture task drains.
+static void standbyInstall() {
+  i2s_config_t i2s_config = {
+    .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX),
+    .sample_rate = g_profile.sample_rate,
+    .bits_per_sample = I2S_BITS_PER_SAMPLE_32BIT,
+    .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
+    .communication_format = I2S_COMM_FORMAT_I2S,
+    .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+    .dma_buf_count = g_profile.dma_buf_count,
+    .dma_buf_len = g_samples_per_frame,
+    .use_apll = false,
+    .tx_desc_auto_clear = false,
+    .fixed_mclk = 0
+  };
+
+  i2s_pin_config_t pin_config = {
+    .bck_io_num = I2S_ALT_SCK,
+    .ws_io_num = I2S_ALT_WS,
+    .data_out_num = I2S_PIN_NO_CHANGE,
+    .data_in_num = I2S_ALT_SD
+  };
+
+  esp_err_t err = i2s_driver_install(I2S_NUM_1, &i2s_config, 0, NULL);
+  if (err != ESP_OK) {
+    Serial.print("WARNING: standby i2s_driver_install failed: ");
+    Serial.println(err);
+    return;  // not fatal; node just runs without a warm standby
+  }
+
+  err = i2s_set_pin(I2S_NUM_1, &pin_config);
+  if (err == ESP_OK) {
+    err = i2s_set_clk(I2S_NUM_1, g_profile.sample_rate, I2S_BITS_PER_SAMPLE_32BIT, I2S_CHANNEL_STEREO);
+  }
+  if (err != ESP_OK) {
+    Serial.print("WARNING: standby I2S config failed: ");
+    Serial.println(err);
+    i2s_driver_uninstall(I2S_NUM_1);
+    return;
+  }
+
+  i2s_zero_dma_buffer(I2S_NUM_1);
+  g_standby_installed = true;
+  Serial.printf("I2S warm standby on alt pins WS=%d SCK=%d SD=%d\n", I2S_ALT_WS, I2S_ALT_SCK, I2S_ALT_SD);
+}
+#endif
+
 static int countNonZero(const int32_t* data, int len) {
   int count = 0;
   for (int i = 0; i < len; i++) {
@@ -115,9 +1963,176 @@ static int countNonZero(const int32_t* data, int len) {
   return count;
 }
 
+// ========= Watchdog supervision & crash recovery =========
+// A wedged Wi-Fi driver or a stalled I2S DMA used to leave the node silent
+// until someone power-cycled it. The capture and sender tasks now publish
+// heartbeat timestamps every iteration; loop() compares them against the
+// stall ladder below and recovers in stages - reopen the socket, reassociate
+// Wi-Fi, reinstall the I2S driver - before giving up and calling
+// esp_restart(). The loop task itself sits on the hardware task watchdog so
+// a wedged supervisor still reboots. Streaming state is mirrored into RTC
+// slow memory, which survives any restart short of power loss, so a reboot
+// skips the NVS reads and the boot settle delay and resumes on the cached
+// BSSID in well under a second.
+#define WDT_TIMEOUT_S 15        // hardware backstop on the supervisor itself
+#define STALL_SOCKET_MS 2000    // sender quiet: reopen the socket
+#define STALL_WIFI_MS 5000      // still quiet: reassociate Wi-Fi
+#define STALL_I2S_MS 2000       // capture quiet: reinstall the I2S driver
+#define STALL_RESTART_MS 12000  // stages didn't take: restart
+
+static volatile int64_t g_capture_alive_us = 0;
+static volatile int64_t g_sender_alive_us = 0;
+
+// Mirror of the streaming config plus the live TX sequence number. The
+// sequence counter lives here permanently (RTC memory is ordinary RAM to
+// the CPU) so a restart continues the sequence space instead of rewinding
+// it - the server sees a loss burst, not a new stream.
+struct RtcState {
+  uint32_t magic;
+  uint32_t tx_seq;
+  uint32_t sample_rate;
+  uint16_t frame_ms;
+  uint16_t dest_port;
+  char dest_addr[16];
+  uint8_t dma_buf_count;
+  uint8_t power_mode;
+  uint8_t use_right;
+  uint8_t recovery_restarts;  // watchdog-initiated restarts since power-on
+};
+#define RTC_STATE_MAGIC 0x52435631  // "RCV1"
+
+RTC_DATA_ATTR static RtcState g_rtc;
+static bool g_warm_boot = false;
+static esp_reset_reason_t g_reset_reason = ESP_RST_UNKNOWN;
+
+// Runs before Serial is up; decides whether the RTC mirror is trustworthy.
+static void rtcStateLoad() {
+  g_reset_reason = esp_reset_reason();
+  bool soft = g_reset_reason == ESP_RST_SW || g_reset_reason == ESP_RST_PANIC ||
+              g_reset_reason == ESP_RST_INT_WDT || g_reset_reason == ESP_RST_TASK_WDT ||
+              g_reset_reason == ESP_RST_WDT;
+  // The magic is only ever written by rtcStateCapture(), which first runs at
+  // the end of setup() - a crash before that (say a watchdog reset while the
+  // AP is down) leaves the mirror unmarked and the next boot takes the NVS
+  // path. The field checks are belt and braces against RTC corruption:
+  // adopting a zero sample rate or DMA count would fail I2S install and spin
+  // capture on empty reads, and since every subsequent reset is soft the
+  // node would wedge until a power cycle. Same bounds loadAudioProfile
+  // clamps to.
+  bool sane = g_rtc.magic == RTC_STATE_MAGIC &&
+              g_rtc.sample_rate >= 8000 && g_rtc.sample_rate <= 48000 &&
+              g_rtc.frame_ms >= 5 &&
+              g_rtc.dma_buf_count >= 2 && g_rtc.dma_buf_count <= 16 &&
+              g_rtc.dest_port != 0 && g_rtc.dest_addr[0] != '\0';
+  if (sane && soft) {
+    g_warm_boot = true;
+    // Frames captured between the last mirror and the crash already went out
+    // with higher sequence numbers; skip ahead so we never reuse one.
+    g_rtc.tx_seq += 256;
+    return;
+  }
+  memset(&g_rtc, 0, sizeof(g_rtc));
+}
+
+// Refresh the mirror from the live config; called from setup() and once per
+// stats window so control-channel changes reach RTC within a second.
+static void rtcStateCapture() {
+  g_rtc.sample_rate = g_profile.sample_rate;
+  g_rtc.frame_ms = g_profile.frame_ms;
+  g_rtc.dma_buf_count = g_profile.dma_buf_count;
+  g_rtc.dest_port = g_dest_port;
+  memcpy(g_rtc.dest_addr, g_dest_addr, sizeof(g_rtc.dest_addr));
+  g_rtc.power_mode = g_power_mode;
+  g_rtc.use_right = g_use_right_channel ? 1 : 0;
+  // Written last: the mirror only becomes adoptable once fully populated.
+  g_rtc.magic = RTC_STATE_MAGIC;
+}
+
+// Adopt the mirrored config on a warm boot instead of re-reading NVS.
+static void rtcStateAdopt() {
+  g_profile.sample_rate = g_rtc.sample_rate;
+  g_profile.frame_ms = g_rtc.frame_ms;
+  g_profile.dma_buf_count = g_rtc.dma_buf_count;
+  g_dest_port = g_rtc.dest_port;
+  memcpy(g_dest_addr, g_rtc.dest_addr, sizeof(g_dest_addr));
+  g_dest_addr[sizeof(g_dest_addr) - 1] = '\0';
+  g_use_right_channel = g_rtc.use_right != 0;
+  g_samples_per_frame = (int)((g_profile.sample_rate * g_profile.frame_ms) / 1000);
+  if (g_samples_per_frame > BUFFER_SIZE) g_samples_per_frame = BUFFER_SIZE;
+}
+
+// Staged recovery, called from loop() every cycle. Each stage fires once per
+// stall; a healthy heartbeat rearms the ladder.
+static void watchdogSupervise() {
+  int64_t now = esp_timer_get_time();
+  int64_t sender_ms = (now - g_sender_alive_us) / 1000;
+  int64_t capture_ms = (now - g_capture_alive_us) / 1000;
+  static uint8_t sender_stage = 0;
+  static bool i2s_recovered = false;
+
+  if (sender_ms < STALL_SOCKET_MS) sender_stage = 0;
+  if (capture_ms < STALL_I2S_MS) i2s_recovered = false;
+
+  if (sender_ms >= STALL_RESTART_MS || capture_ms >= STALL_RESTART_MS) {
+    rtcStateCapture();
+    g_rtc.recovery_restarts++;
+    Serial.printf("Watchdog: pipeline dead (capture %lldms, sender %lldms), restarting\n",
+                  (long long)capture_ms, (long long)sender_ms);
+    Serial.flush();
+    esp_restart();
+  }
+
+  if (sender_stage == 1 && sender_ms >= STALL_WIFI_MS) {
+    g_counters.stall_recoveries++;
+    Serial.printf("Watchdog: sender stalled %lldms, reassociating Wi-Fi\n", (long long)sender_ms);
+    WiFi.disconnect();
+    if (connectWiFi()) transportInit();
+    sender_stage = 2;
+  } else if (sender_stage == 0 && sender_ms >= STALL_SOCKET_MS) {
+    g_counters.stall_recoveries++;
+    Serial.printf("Watchdog: sender stalled %lldms, reopening socket\n", (long long)sender_ms);
+#if USE_WEBSOCKET
+    wsTeardownLocked();
+#endif
+    if (g_udp_sock >= 0) {
+      close(g_udp_sock);
+      g_udp_sock = -1;
+    }
+    transportInit();
+    sender_stage = 1;
+  }
+
+  if (!i2s_recovered && capture_ms >= STALL_I2S_MS) {
+    g_counters.stall_recoveries++;
+    Serial.printf("Watchdog: capture stalled %lldms, reinstalling I2S\n", (long long)capture_ms);
+#if !DUAL_MIC
+    // Point the capture task back at the primary bus, then uninstall both;
+    // a read blocked in the wedged driver returns an error once its port
+    // goes away, and the task picks up the fresh install on the next pass.
+    g_capture_port = I2S_NUM_0;
+    if (g_standby_installed) {
+      i2s_driver_uninstall(I2S_NUM_1);
+      g_standby_installed = false;
+    }
+    reinitI2S(g_use_right_channel);
+    standbyInstall();
+#else
+    reinitI2S(g_use_right_channel);
+#endif
+    i2s_recovered = true;
+  }
+}
+
 void setup() {
+  rtcStateLoad();
   Serial.begin(115200);
-  delay(1000);
+  // Warm restarts skip the serial settle delay; every ms here is dead air.
+  delay(g_warm_boot ? 50 : 1000);
+  if (g_warm_boot) {
+    Serial.printf("Warm restart (reason %d, #%u): resuming from RTC state, seq=%lu\n",
+                  (int)g_reset_reason, (unsigned)g_rtc.recovery_restarts,
+                  (unsigned long)g_rtc.tx_seq);
+  }
   if (FORCE_GPIO48_LOW) {
     pinMode(48, OUTPUT);
     digitalWrite(48, LOW);
@@ -171,33 +2186,53 @@ void setup() {
   Serial.println("⚠️  If you see all 0x00 samples, check: mic VDD, GND, SD wiring, and L/R channel selection.");
   delay(100);
   
-  // Connect to WiFi
+  loadWifiTxProfile();
+
+  // Connect to WiFi (fast path via cached BSSID/channel when available)
   Serial.print("Connecting to WiFi: ");
   Serial.println(ssid);
-  WiFi.mode(WIFI_STA);
-  WiFi.setSleep(false);
-  WiFi.begin(ssid, password);
-  
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
+  while (!connectWiFi()) {
+    Serial.println("WiFi: connect failed, retrying...");
   }
-  
-  Serial.println("\nWiFi connected!");
+
+  Serial.println("WiFi connected!");
   Serial.print("IP address: ");
   Serial.println(WiFi.localIP());
+  if (g_warm_boot) {
+    // Config was mirrored into RTC memory before the restart; skip the NVS
+    // namespace opens entirely.
+    rtcStateAdopt();
+    if (g_rtc.power_mode != POWER_MODE_PERF) powerApply(g_rtc.power_mode);
+  } else {
+    loadNetDest();
+    loadAudioProfile();
+
+    // Battery nodes keep their power profile across reboots.
+    g_prefs.begin("power", true);
+    uint8_t power_mode = g_prefs.getUChar("mode", POWER_MODE_PERF);
+    g_prefs.end();
+    if (power_mode != POWER_MODE_PERF) powerApply(power_mode);
+    rtcStateCapture();
+  }
   Serial.print("Streaming to: ");
-  Serial.print(udpAddress);
+  Serial.print(g_dest_addr);
   Serial.print(":");
-  Serial.println(udpPort);
-  
-  // Initialize I2S
+  Serial.println(g_dest_port);
+  if (!transportInit()) {
+    Serial.println("WARNING: transport init failed; link monitor will retry");
+  }
+
+  // Initialize I2S with the boot profile
   Serial.println("Initializing I2S...");
   setupI2S(g_use_right_channel);
+#if !DUAL_MIC
+  standbyInstall();
+#endif
 
   // Quick self-test to help diagnose "all zeros" issues.
   // If you power from GPIO, we can power-cycle and see if raw samples change.
-  if (MIC_POWER_FROM_GPIO) {
+  // Skipped on warm restarts - it costs ~700ms and the wiring didn't change.
+  if (MIC_POWER_FROM_GPIO && !g_warm_boot) {
     Serial.println("Mic power self-test (GPIO power): sampling with VDD LOW then HIGH...");
     digitalWrite(VDD1, LOW);
     delay(150);
@@ -232,81 +2267,467 @@ void setup() {
   
   Serial.println("Starting audio stream...");
   Serial.print("Sample Rate: ");
-  Serial.print(SAMPLE_RATE);
+  Serial.print(g_profile.sample_rate);
   Serial.println(" Hz");
+
+  ringInit();
+
+  // Arm the heartbeats so the supervisor doesn't see boot time as a stall,
+  // and put the loop task on the hardware watchdog as the final backstop.
+  g_capture_alive_us = esp_timer_get_time();
+  g_sender_alive_us = g_capture_alive_us;
+  esp_task_wdt_init(WDT_TIMEOUT_S, true);
+  esp_task_wdt_add(NULL);
+
+  // Launch the pipeline: capture on core 0, sender on core 1, stats reporter
+  // at low priority alongside the sender.
+  xTaskCreatePinnedToCore(senderTask, "udp_send", 4096, NULL, SENDER_TASK_PRIO, &sender_task_handle, SENDER_CORE);
+  xTaskCreatePinnedToCore(captureTask, "i2s_capture", 4096, NULL, CAPTURE_TASK_PRIO, &capture_task_handle, CAPTURE_CORE);
+  xTaskCreatePinnedToCore(statsTask, "stats", 4096, NULL, STATS_TASK_PRIO, &stats_task_handle, SENDER_CORE);
 }
 
-void loop() {
-  size_t bytes_read = 0;
-  // Read from I2S
-  esp_err_t result = i2s_read(I2S_NUM_0, i2s_buffer, BUFFER_SIZE * sizeof(int32_t), &bytes_read, portMAX_DELAY);
-  if (result != ESP_OK) {
-    static uint32_t err_count = 0;
-    if (++err_count % 50 == 0) {
-      Serial.print("ERROR: i2s_read failed: ");
-      Serial.println(result);
+// Capture task (core 0): drain I2S DMA, convert 32->16 bit, push frames into
+// the ring. Never touches the network or the UART, so nothing can stall it;
+// diagnostics are counters the stats task reports asynchronously.
+static void captureTask(void* arg) {
+  (void)arg;
+  for (;;) {
+    size_t bytes_read = 0;
+    uint32_t c0 = esp_cpu_get_cycle_count();
+#if DUAL_MIC
+    esp_err_t result = i2s_read(I2S_NUM_0, i2s_buffer, g_samples_per_frame * sizeof(int32_t), &bytes_read, portMAX_DELAY);
+#else
+    // Pending warm-standby probe: pull two frames from the idle bus (the
+    // first may be stale DMA) and cut over between frames if either slot
+    // shows signal. On a dead standby the ~2-frame probe cost is the active
+    // bus's DMA depth to absorb; on success the old bus becomes the standby.
+    if (g_standby_probe) {
+      g_standby_probe = false;
+      if (g_standby_installed) {
+        i2s_port_t other = (g_capture_port == I2S_NUM_0) ? I2S_NUM_1 : I2S_NUM_0;
+        size_t probe_bytes = 0;
+        (void)i2s_read(other, i2s_stereo_buffer, g_samples_per_frame * 2 * sizeof(int32_t), &probe_bytes, pdMS_TO_TICKS(100));
+        probe_bytes = 0;
+        (void)i2s_read(other, i2s_stereo_buffer, g_samples_per_frame * 2 * sizeof(int32_t), &probe_bytes, pdMS_TO_TICKS(100));
+        if (countNonZero(i2s_stereo_buffer, (int)(probe_bytes / sizeof(int32_t))) > 0) {
+          g_capture_port = other;
+          g_counters.pin_failovers++;
+          g_counters.zero_frame_streak = 0;
+          Serial.printf("I2S failover: capture now on port %d (%s pins)\n",
+                        (int)other, other == I2S_NUM_1 ? "alternate" : "primary");
+        }
+      }
     }
-    return;
-  }
+    esp_err_t result = i2s_read(g_capture_port, i2s_stereo_buffer, g_samples_per_frame * 2 * sizeof(int32_t), &bytes_read, portMAX_DELAY);
+#endif
+    histRecord(g_hist_read, cyclesToUs(esp_cpu_get_cycle_count() - c0));
+    g_capture_alive_us = esp_timer_get_time();  // watchdog heartbeat
+    if (result != ESP_OK) {
+      g_counters.i2s_read_errors++;
+      continue;
+    }
+    if (bytes_read == 0) continue;
+    if (g_bench_active) continue;  // benchmark owns the socket; keep DMA drained
+    int64_t read_time_us = esp_timer_get_time();
 
-  if (bytes_read > 0) {
+#if DUAL_MIC
     int samples_read = bytes_read / sizeof(int32_t);
-    
-    // Convert 32-bit samples to 16-bit for UDP transmission
-    for (int i = 0; i < samples_read; i++) {
-      // INMP441 outputs 24-bit data in upper bits of 32-bit word
-      // Common Arduino/ESP32 INMP441 wiring expects a >>14 shift for PCM16.
-      int16_t sample = (int16_t)(i2s_buffer[i] >> 14);
-      udp_buffer[i * 2] = sample & 0xFF;
-      udp_buffer[i * 2 + 1] = (sample >> 8) & 0xFF;
-    }
-    
-    // Send via UDP
-    udp.beginPacket(udpAddress, udpPort);
-    udp.write(udp_buffer, samples_read * 2);
-    udp.endPacket();
-    
-    // Debug: Print raw I2S values and converted samples every 100 packets
-    static int packet_count = 0;
-    static bool tried_channel_swap = false;
-    if (++packet_count >= 100) {
-      int32_t raw_min = INT32_MAX;
-      int32_t raw_max = INT32_MIN;
-      int raw_nonzero = 0;
+#else
+    int samples_read = bytes_read / (2 * sizeof(int32_t));
+
+    // Deinterleave the live slot out of the stereo DMA stream, counting the
+    // standby slot's nonzero samples in the same pass so failover can see
+    // whether the mic is actually on the other phase.
+    int standby_nonzero = 0;
+    {
+      const int active = g_active_slot;
       for (int i = 0; i < samples_read; i++) {
-        int32_t v = i2s_buffer[i];
-        if (v != 0) raw_nonzero++;
-        if (v < raw_min) raw_min = v;
-        if (v > raw_max) raw_max = v;
+        i2s_buffer[i] = i2s_stereo_buffer[i * 2 + active];
+        if (i2s_stereo_buffer[i * 2 + (active ^ 1)] != 0) standby_nonzero++;
       }
+    }
+#endif
 
-      Serial.print("Streaming... samples: ");
-      Serial.print(samples_read);
-      Serial.print(" | RawNonZero: ");
-      Serial.print(raw_nonzero);
-      Serial.print(" | RawMin: ");
-      Serial.print(raw_min);
-      Serial.print(" | RawMax: ");
-      Serial.print(raw_max);
-      Serial.print(" | Raw I2S[0-4]: ");
-      for(int i = 0; i < 5 && i < samples_read; i++) {
-        Serial.print(i2s_buffer[i], HEX);
-        Serial.print(" ");
+#if DUAL_MIC
+    // Both controllers run the same clock, so mic 1 has the same number of
+    // samples waiting; this read returns almost immediately.
+    size_t bytes_read2 = 0;
+    result = i2s_read(I2S_NUM_1, i2s_buffer2, samples_read * sizeof(int32_t), &bytes_read2, portMAX_DELAY);
+    if (result != ESP_OK) {
+      g_counters.i2s_read_errors++;
+      continue;
+    }
+    int samples_read2 = bytes_read2 / sizeof(int32_t);
+    if (samples_read2 < samples_read) samples_read = samples_read2;
+#endif
+
+    uint32_t head = ring_head.load(std::memory_order_relaxed);
+    uint32_t tail = ring_tail.load(std::memory_order_acquire);
+    if (head - tail >= g_ring_frames) {
+      // Ring full: the sender has been stalled past the ring depth. Drop this
+      // frame rather than block and back up into the DMA queue.
+      g_counters.frames_dropped++;
+      continue;
+    }
+    AudioFrame* frame = &frame_ring[head % g_ring_frames];
+
+    // Convert 32-bit samples straight into the wire payload. One word store
+    // per sample; the only remaining copy is udp.write() into the Wi-Fi stack.
+    // INMP441 outputs 24-bit data in upper bits of 32-bit word; the common
+    // Arduino/ESP32 INMP441 wiring expects a >>14 shift for PCM16.
+    uint8_t flags = DUAL_MIC ? PKT_FLAG_STEREO : 0;
+    uint16_t fmt = PCM_FMT_S16;
+    c0 = esp_cpu_get_cycle_count();
+#if DUAL_MIC
+    convertFrameStereo(i2s_buffer, i2s_buffer2, (int16_t*)frame->payload, samples_read, g_frame_stats);
+    frame->payload_len = (size_t)samples_read * NUM_CHANNELS * sizeof(int16_t);
+#else
+    if (g_adpcm_enabled) {
+      // Convert into scratch, then (optionally) decimate and compress into
+      // the wire payload.
+      static int16_t pcm_scratch[BUFFER_SIZE];
+      convertFrame(i2s_buffer, pcm_scratch, samples_read, g_frame_stats);
+      if (g_decimate_half) {
+        samples_read = decimateBy2(pcm_scratch, samples_read);
+        flags |= PKT_FLAG_HALF_RATE;
       }
-      Serial.print(" | Converted[0]: ");
-      int16_t sample0 = (int16_t)(i2s_buffer[0] >> 14);
-      Serial.println(sample0);
-      if (raw_nonzero == 0) {
-        Serial.println("WARNING: All raw samples are 0. Likely mic is unpowered, SD pin is wrong/disconnected, or L/R channel mismatch.");
-        if (!tried_channel_swap) {
-          tried_channel_swap = true;
-          g_use_right_channel = !g_use_right_channel;
-          Serial.print("Attempting channel swap. New channel: ");
-          Serial.println(g_use_right_channel ? "RIGHT" : "LEFT");
-          reinitI2S(g_use_right_channel);
+      samples_read &= ~1;  // encoder packs sample pairs
+      frame->payload_len = adpcmEncodeFrame(pcm_scratch, samples_read, frame->payload);
+      flags |= PKT_FLAG_ADPCM;
+    } else if (g_pcm24_enabled) {
+      // Full-resolution path: no decimation, no AGC - the extra bits are
+      // the point. VAD gating still applies via the fused stats.
+      convertFrame24(i2s_buffer, frame->payload, samples_read, g_frame_stats);
+      frame->payload_len = (size_t)samples_read * 3;
+      fmt = PCM_FMT_S24;
+    } else {
+      convertFrame(i2s_buffer, (int16_t*)frame->payload, samples_read, g_frame_stats);
+      if (g_decimate_half) {
+        samples_read = decimateBy2((int16_t*)frame->payload, samples_read);
+        flags |= PKT_FLAG_HALF_RATE;
+      }
+      frame->payload_len = (size_t)samples_read * sizeof(int16_t);
+    }
+#endif
+    histRecord(g_hist_convert, cyclesToUs(esp_cpu_get_cycle_count() - c0));
+    frame->sample_count = samples_read;
+
+    // Header written in place, same buffer the sender ships. The sequence
+    // counter lives in RTC memory so a watchdog restart continues it.
+    frame->hdr.magic = PACKET_MAGIC;
+    frame->hdr.version = PACKET_VERSION;
+    frame->hdr.flags = flags;
+    frame->hdr.seq = g_rtc.tx_seq++;
+    frame->hdr.timestamp_us = syncToServerUs((uint64_t)read_time_us);
+    frame->hdr.sample_count = (uint16_t)samples_read;
+    frame->hdr.reserved = fmt;
+    {
+      uint32_t frame_rms = frameRms(g_frame_stats);
+      frame->hdr.rms = (uint16_t)(frame_rms > 0xFFFF ? 0xFFFF : frame_rms);
+      frame->hdr.peak = (uint16_t)(g_frame_stats.peak > 0xFFFF ? 0xFFFF : g_frame_stats.peak);
+      frame->hdr.zero_cross = (uint16_t)g_frame_stats.zero_crossings;
+      frame->hdr.reserved2 = 0;
+    }
+
+    // Energy gate: collapse silent frames (past the hangover) to header-only
+    // keepalives so the link carries energy info but no payload. At the
+    // bottom of the degradation ladder every frame is gated.
+    if (g_vad_enabled || g_keepalive_only) {
+      uint32_t rms = frameRms(g_frame_stats);
+      static uint32_t hangover_left = 0;
+      if (!g_keepalive_only && rms >= g_vad_threshold_rms) {
+        hangover_left = g_vad_hangover_frames;
+      } else if (hangover_left > 0) {
+        hangover_left--;
+      } else {
+        frame->payload_len = 0;
+        frame->hdr.flags |= PKT_FLAG_KEEPALIVE;
+        frame->hdr.sample_count = 0;
+        frame->hdr.reserved = (uint16_t)(rms > 0xFFFF ? 0xFFFF : rms);
+        g_counters.frames_gated++;
+      }
+    }
+
+    ring_head.store(head + 1, std::memory_order_release);
+    if (sender_task_handle) xTaskNotifyGive(sender_task_handle);
+    g_counters.frames_captured++;
+
+    // Stuck-at-zero mic detection from the fused frame stats.
+#if DUAL_MIC
+    // Two dedicated buses: nothing to fail over to, just keep the streak
+    // counter for the stats report.
+    if (g_frame_stats.raw_nonzero == 0) {
+      g_counters.zero_frame_streak++;
+    } else {
+      g_counters.zero_frame_streak = 0;
+    }
+#else
+    // Gapless failover: the bus is captured in stereo, so switching slots is
+    // a software flip between frames - no driver teardown, no dropout. If the
+    // standby slot shows signal we cut over immediately; if both are quiet we
+    // periodically try the other slot anyway, with growing backoff so a truly
+    // dead mic doesn't make us flap.
+    if (g_frame_stats.raw_nonzero == 0) {
+      g_counters.zero_frame_streak++;
+      static uint32_t swap_holdoff = 3;  // settle time after install/swap
+      static uint32_t blind_swap_backoff = ZERO_STREAK_SWAP_THRESHOLD;
+      if (swap_holdoff > 0) {
+        swap_holdoff--;
+      } else if (standby_nonzero > 0) {
+        g_active_slot ^= 1;
+        g_use_right_channel = (g_active_slot == 1);
+        g_counters.channel_swaps++;
+        swap_holdoff = 3;
+      } else if (g_counters.zero_frame_streak >= blind_swap_backoff) {
+        g_active_slot ^= 1;
+        g_use_right_channel = (g_active_slot == 1);
+        g_counters.channel_swaps++;
+        g_counters.zero_frame_streak = 0;
+        if (blind_swap_backoff < ZERO_STREAK_SWAP_THRESHOLD * 8) {
+          blind_swap_backoff *= 2;
+        } else if (g_standby_installed) {
+          // Both slots of this bus have been tried repeatedly; the wiring is
+          // probably on the other header. Escalate to the warm standby.
+          g_standby_probe = true;
         }
+        swap_holdoff = 3;
+      }
+    } else {
+      g_counters.zero_frame_streak = 0;
+    }
+#endif
+  }
+}
+
+// Sender task (core 1): pop converted frames from the ring and push them out
+// over UDP. Blocking in the Wi-Fi stack here only costs ring slots, not audio.
+static void senderTask(void* arg) {
+  (void)arg;
+  for (;;) {
+    g_sender_alive_us = esp_timer_get_time();  // watchdog heartbeat
+    uint32_t tail = ring_tail.load(std::memory_order_relaxed);
+    uint32_t head = ring_head.load(std::memory_order_acquire);
+    if (tail == head) {
+      // Wait for the capture task to publish a frame (timeout as a safety net).
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+      continue;
+    }
+    uint32_t batch_target = g_batch_frames;
+    if (batch_target > BATCH_MAX_FRAMES) batch_target = BATCH_MAX_FRAMES;
+
+    uint32_t sent_frames;
+    bool ok;
+    uint32_t c0 = esp_cpu_get_cycle_count();
+    if (batch_target <= 1 || head - tail == 1) {
+      AudioFrame* frame = &frame_ring[tail % g_ring_frames];
+      ok = sendFrameBytes((const uint8_t*)&frame->hdr, sizeof(PacketHeader) + frame->payload_len);
+      sent_frames = 1;
+    } else {
+      // Coalesce up to batch_target ready frames into one datagram. Each
+      // keeps its own header, so the receiver just walks header -> payload.
+      // The copy into the batch buffer is the price of the mode; single-frame
+      // sends stay zero-copy.
+      static uint8_t batch_buf[BATCH_MAX_FRAMES * sizeof(AudioFrame)];
+      size_t batch_len = 0;
+      sent_frames = 0;
+      while (sent_frames < batch_target && tail + sent_frames != head) {
+        AudioFrame* frame = &frame_ring[(tail + sent_frames) % g_ring_frames];
+        size_t chunk = sizeof(PacketHeader) + frame->payload_len;
+        // Byte budget beats frame count: stop before the datagram would
+        // exceed one Wi-Fi MTU and get IP-fragmented (see BATCH_MAX_BYTES).
+        // The first frame always ships, even if a single chunk is oversized
+        // (dual-mic stereo at 512 samples) - that fragments with or without
+        // batching and is the capture profile's problem, not the sender's.
+        if (sent_frames > 0 && batch_len + chunk > BATCH_MAX_BYTES) break;
+        memcpy(batch_buf + batch_len, &frame->hdr, chunk);
+        batch_len += chunk;
+        sent_frames++;
       }
-      packet_count = 0;
+      ok = sendFrameBytes(batch_buf, batch_len);
+    }
+    histRecord(g_hist_send, cyclesToUs(esp_cpu_get_cycle_count() - c0));
+
+    if (ok) {
+      g_counters.frames_sent += sent_frames;
+    } else {
+      // Send failed (radio down, roaming, or transport backpressure): keep
+      // the frames and retry after a short backoff - the deep ring absorbs
+      // the capture side and header timestamps let the server reassemble the
+      // burst drain in order. Once the ring is full, drop the oldest frame
+      // instead of stalling behind it so capture never blocks and the stream
+      // stays fresh when the link returns.
+      g_counters.send_failures++;
+      if (head - tail >= g_ring_frames) {
+        // Separate counter from frames_dropped: that one belongs to the
+        // capture task, and the single-writer-per-field rule is what lets
+        // these stay plain uint32s.
+        g_counters.frames_aged_out++;
+        ring_tail.store(tail + 1, std::memory_order_release);
+      }
+      vTaskDelay(pdMS_TO_TICKS(20));
+      continue;
+    }
+
+    ring_tail.store(tail + sent_frames, std::memory_order_release);
+  }
+}
+
+// Stats task (low priority): the only task that prints. Samples the counters
+// and the last frame's fused stats every STATS_REPORT_MS so the old periodic
+// Serial block no longer sits between I2S reads.
+static void statsTask(void* arg) {
+  (void)arg;
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(g_stats_report_ms));
+
+    const FrameStats st = g_frame_stats;  // snapshot (single writer)
+    uint32_t rms = frameRms(st);
+
+    // One report window of send outcomes scores the degradation ladder.
+    static uint32_t ladder_last_sent = 0;
+    static uint32_t ladder_last_failed = 0;
+    uint32_t window_sent = g_counters.frames_sent - ladder_last_sent;
+    uint32_t window_failed = g_counters.send_failures - ladder_last_failed;
+    ladder_last_sent = g_counters.frames_sent;
+    ladder_last_failed = g_counters.send_failures;
+    if (g_ladder_enabled) ladderEvaluate(window_sent, window_failed);
+    rtcStateCapture();  // keep the crash-recovery mirror current
+
+    if (g_stats_serial) {
+      Serial.printf("Streaming... captured=%lu sent=%lu dropped=%lu agedOut=%lu sendFail=%lu i2sErr=%lu swaps=%lu ch=%s\n",
+                    (unsigned long)g_counters.frames_captured,
+                    (unsigned long)g_counters.frames_sent,
+                    (unsigned long)g_counters.frames_dropped,
+                    (unsigned long)g_counters.frames_aged_out,
+                    (unsigned long)g_counters.send_failures,
+                    (unsigned long)g_counters.i2s_read_errors,
+                    (unsigned long)g_counters.channel_swaps,
+                    g_use_right_channel ? "RIGHT" : "LEFT");
+#if !DUAL_MIC
+      if (g_counters.pin_failovers > 0) {
+        Serial.printf("  i2s: pinFailovers=%lu port=%d\n",
+                      (unsigned long)g_counters.pin_failovers, (int)g_capture_port);
+      }
+#endif
+      if (g_counters.stall_recoveries > 0 || g_rtc.recovery_restarts > 0) {
+        Serial.printf("  watchdog: recoveries=%lu restarts=%u\n",
+                      (unsigned long)g_counters.stall_recoveries,
+                      (unsigned)g_rtc.recovery_restarts);
+      }
+      if (g_vad_enabled) {
+        Serial.printf("  vad: gated=%lu threshold=%lu\n",
+                      (unsigned long)g_counters.frames_gated,
+                      (unsigned long)g_vad_threshold_rms);
+      }
+      Serial.printf("  frame: samples=%d RawNonZero=%d RawMin=%ld RawMax=%ld RMS=%lu Converted[0]=%d\n",
+                    st.sample_count, st.raw_nonzero, (long)st.raw_min, (long)st.raw_max,
+                    (unsigned long)rms, (int)st.pcm_first);
+      if (g_counters.zero_frame_streak >= ZERO_STREAK_SWAP_THRESHOLD) {
+        Serial.println("WARNING: All raw samples are 0. Likely mic is unpowered, SD pin is wrong/disconnected, or L/R channel mismatch.");
+      }
+      if (g_clock_synced) {
+        Serial.printf("  sync: offset=%lld us drift=%lld ppb rttBest=%lu us exchanges=%lu\n",
+                      (long long)g_clock_offset_us, (long long)g_clock_drift_ppb,
+                      (unsigned long)g_sync_best_rtt_us, (unsigned long)g_sync_exchanges);
+      }
+      Serial.printf("  stages(us): read avg=%lu max=%lu | convert avg=%lu max=%lu | send avg=%lu max=%lu\n",
+                    (unsigned long)(g_hist_read.count ? g_hist_read.total_us / g_hist_read.count : 0),
+                    (unsigned long)g_hist_read.max_us,
+                    (unsigned long)(g_hist_convert.count ? g_hist_convert.total_us / g_hist_convert.count : 0),
+                    (unsigned long)g_hist_convert.max_us,
+                    (unsigned long)(g_hist_send.count ? g_hist_send.total_us / g_hist_send.count : 0),
+                    (unsigned long)g_hist_send.max_us);
+      Serial.printf("  wifi: rssi=%d dBm txPwr=%d.%02d dBm tos=0x%02x\n",
+                    (int)WiFi.RSSI(), g_wifi_tx.max_tx_power_q2 / 4,
+                    (g_wifi_tx.max_tx_power_q2 % 4) * 25, (unsigned)g_wifi_tx.tos);
+      if (g_ladder_level > 0) {
+        Serial.printf("  ladder: level=%d batch=%lu adpcm=%d halfRate=%d keepaliveOnly=%d\n",
+                      g_ladder_level, (unsigned long)g_batch_frames,
+                      g_adpcm_enabled ? 1 : 0, g_decimate_half ? 1 : 0,
+                      g_keepalive_only ? 1 : 0);
+      }
+      for (int i = 0; i < g_extra_sink_count; i++) {
+        Serial.printf("  sink[%d]: %u.%u.%u.%u:%u failures=%lu\n", i,
+                      (unsigned)(g_extra_sinks[i].ip & 0xff),
+                      (unsigned)((g_extra_sinks[i].ip >> 8) & 0xff),
+                      (unsigned)((g_extra_sinks[i].ip >> 16) & 0xff),
+                      (unsigned)((g_extra_sinks[i].ip >> 24) & 0xff),
+                      (unsigned)g_extra_sinks[i].port,
+                      (unsigned long)g_extra_sinks[i].send_failures);
+      }
+    }
+
+    // Export the raw histograms + counters as a binary stats datagram so
+    // fleet nodes can be profiled without touching the UART.
+    static int report_count = 0;
+    if (++report_count >= STATS_PACKET_EVERY) {
+      report_count = 0;
+      static struct __attribute__((packed)) {
+        PacketHeader hdr;
+        StatsPacket body;
+      } stats_msg;
+      static uint32_t stats_seq = 0;
+      stats_msg.hdr.magic = PACKET_MAGIC;
+      stats_msg.hdr.version = PACKET_VERSION;
+      stats_msg.hdr.flags = PKT_FLAG_STATS;
+      stats_msg.hdr.seq = stats_seq++;
+      stats_msg.hdr.timestamp_us = syncToServerUs((uint64_t)esp_timer_get_time());
+      stats_msg.hdr.sample_count = 0;
+      stats_msg.hdr.reserved = 0;
+      memcpy(&stats_msg.body.counters, (const void*)&g_counters, sizeof(PipelineCounters));
+      stats_msg.body.read_hist = g_hist_read;
+      stats_msg.body.convert_hist = g_hist_convert;
+      stats_msg.body.send_hist = g_hist_send;
+      stats_msg.body.power_mode = g_power_mode;
+      stats_msg.body.tx_power_q2 = g_wifi_tx.max_tx_power_q2;
+      stats_msg.body.tos = g_wifi_tx.tos;
+      stats_msg.body.cpu_mhz = getCpuFrequencyMhz();
+      sendFrameBytes((const uint8_t*)&stats_msg, sizeof(stats_msg));
+    }
+  }
+}
+
+void loop() {
+  // The audio pipeline runs in its own tasks; the Arduino loop doubles as the
+  // Wi-Fi link monitor and pipeline supervisor. The capture task keeps
+  // filling the (PSRAM) ring while we reassociate, so a roam costs buffered -
+  // not lost - audio.
+  esp_task_wdt_reset();
+  watchdogSupervise();
+  if (WiFi.status() != WL_CONNECTED) {
+    g_counters.wifi_reconnects++;
+    Serial.println("WiFi: link lost, reconnecting...");
+    if (connectWiFi()) {
+      Serial.println("WiFi: reconnected");
+      // The connected socket may be bound to a stale address; reopen it.
+#if USE_WEBSOCKET
+      wsTeardownLocked();
+#endif
+      if (g_udp_sock >= 0) {
+        close(g_udp_sock);
+        g_udp_sock = -1;
+      }
+      transportInit();
+    }
+  } else {
+#if USE_WEBSOCKET
+    // TCP carries its own clock skew; the UDP sync exchange stays off.
+    if (g_ws_sock < 0) transportInit();
+    wsPoll();
+#else
+    static uint32_t last_sync_ms = 0;
+    uint32_t now_ms = millis();
+    if (now_ms - last_sync_ms >= SYNC_INTERVAL_MS) {
+      last_sync_ms = now_ms;
+      syncSendRequest();
+    }
+    serverPoll();
+#endif
+    if (g_bench_seconds != 0) {
+      uint32_t s = g_bench_seconds;
+      g_bench_seconds = 0;
+      benchRun(s, g_bench_payload);
     }
   }
+  vTaskDelay(pdMS_TO_TICKS(250));
 }
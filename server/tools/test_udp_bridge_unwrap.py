@@ -0,0 +1,97 @@
+"""Smoke test for the UDP bridge's framed-datagram unwrapping.
+
+Feeds synthetic datagrams straight into _UdpProtocol.datagram_received and
+checks what comes out the WebSocket queue: framed PCM16 is unwrapped, batched
+chunks are split, sync/control/stats/keepalive/ADPCM datagrams are dropped,
+legacy bare-PCM16 passes through - including a datagram whose first sample
+happens to equal the header magic.
+
+Run from server/ (no venv needed; websockets is stubbed out):
+
+    python tools/test_udp_bridge_unwrap.py
+"""
+
+from __future__ import annotations
+
+import asyncio
+import importlib.util
+import pathlib
+import sys
+import types
+
+# The bridge imports websockets at module scope but the unwrap path never
+# touches it; stub it so this test runs outside the server venv.
+sys.modules.setdefault("websockets", types.ModuleType("websockets"))
+
+_BRIDGE_PATH = pathlib.Path(__file__).resolve().parent / "udp_to_ws_bridge.py"
+_spec = importlib.util.spec_from_file_location("udp_to_ws_bridge", _BRIDGE_PATH)
+assert _spec is not None and _spec.loader is not None
+bridge = importlib.util.module_from_spec(_spec)
+sys.modules["udp_to_ws_bridge"] = bridge
+_spec.loader.exec_module(bridge)
+
+CHUNK_BYTES = 640  # 320 samples, 20 ms at 16 kHz
+ADDR = ("127.0.0.1", 50000)
+
+
+def _hdr(flags: int, sample_count: int, fmt: int = 0, seq: int = 1) -> bytes:
+    return bridge._PKT_HEADER.pack(
+        bridge._PKT_MAGIC, bridge._PKT_VERSION, flags, seq, 123456, sample_count, fmt, 0, 0, 0, 0
+    )
+
+
+def _drain(queue: asyncio.Queue) -> list[bytes]:
+    out = []
+    while not queue.empty():
+        out.append(queue.get_nowait())
+    return out
+
+
+async def run() -> None:
+    queue: asyncio.Queue[bytes] = asyncio.Queue(maxsize=50)
+    proto = bridge._UdpProtocol(role="left", udp_port=12345, queue=queue, chunk_bytes=CHUNK_BYTES)
+    pcm = (bytes(range(7, 256)) * 4)[:CHUNK_BYTES]
+
+    # Plain framed datagram: header stripped, payload forwarded as one chunk.
+    proto.datagram_received(_hdr(0, CHUNK_BYTES // 2) + pcm, ADDR)
+    assert _drain(queue) == [pcm], "framed PCM16 should be unwrapped to its payload"
+
+    # Batched datagram: two header+payload chunks back to back.
+    proto.datagram_received(_hdr(0, CHUNK_BYTES // 2, seq=2) + pcm + _hdr(0, CHUNK_BYTES // 2, seq=3) + pcm, ADDR)
+    assert _drain(queue) == [pcm, pcm], "batched chunks should be split into separate frames"
+
+    # Non-audio datagrams (clock sync here) and keepalives are dropped whole.
+    proto.datagram_received(_hdr(0x10, 0) + bytes(24), ADDR)
+    proto.datagram_received(_hdr(bridge._PKT_FLAG_KEEPALIVE, CHUNK_BYTES // 2), ADDR)
+    assert _drain(queue) == [], "sync and keepalive datagrams must not reach the queue"
+
+    # ADPCM payloads cannot feed a pcm_s16le stream: dropped, counted.
+    adpcm_len = 4 + (CHUNK_BYTES // 2 + 1) // 2
+    proto.datagram_received(_hdr(bridge._PKT_FLAG_ADPCM, CHUNK_BYTES // 2) + bytes(adpcm_len), ADDR)
+    assert _drain(queue) == [], "ADPCM datagrams must not reach the queue"
+    assert proto._nonaudio_dropped == 2, "sync + ADPCM should both count as non-audio"
+
+    # Legacy bare PCM16 passes through untouched.
+    proto.datagram_received(pcm, ADDR)
+    assert _drain(queue) == [pcm], "legacy bare PCM16 should pass through"
+
+    # Legacy datagram whose first sample is 0x4148 (a loud but plausible
+    # sample) and whose next byte matches the version: the chunk walk does
+    # not consume it cleanly (the bytes where sample_count would sit declare
+    # far more payload than the datagram holds), so it must pass through as
+    # audio, not be misparsed as framed and garbled.
+    lookalike = bytes([0x48, 0x41, 0x02, 0x00]) + pcm[4:16] + b"\xff\x7f" + pcm[18:]
+    framed_before = proto._framed_packets
+    proto.datagram_received(lookalike, ADDR)
+    assert _drain(queue) == [lookalike], "magic-lookalike legacy PCM must pass through"
+    assert proto._framed_packets == framed_before, "lookalike must not count as framed"
+
+    # Wrong version byte short-circuits before any parsing.
+    proto.datagram_received(bytes([0x48, 0x41, 0x01]) + pcm[3:], ADDR)
+    assert _drain(queue) == [bytes([0x48, 0x41, 0x01]) + pcm[3:]]
+
+    print("udp_to_ws_bridge unwrap: all checks passed")
+
+
+if __name__ == "__main__":
+    asyncio.run(run())
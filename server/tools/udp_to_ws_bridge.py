@@ -5,6 +5,7 @@ import asyncio
 import json
 import logging
 import socket
+import struct
 from dataclasses import dataclass
 from typing import Literal
 
@@ -13,6 +14,25 @@ import websockets
 
 Role = Literal["left", "right"]
 
+# Framed packets from the master firmware (docs/ESP32_Protocol.md, v2 header):
+# magic, version, flags, seq, timestamp_us, sample_count, reserved (sample
+# format), rms, peak, zero_cross, reserved2 - all little-endian, 28 bytes.
+# Datagrams that do not start with the magic are legacy bare PCM16.
+_PKT_HEADER = struct.Struct("<HBBIQHHHHHH")
+_PKT_MAGIC = 0x4148  # "HA"
+_PKT_VERSION = 2
+_PKT_FLAG_STEREO = 0x01
+_PKT_FLAG_ADPCM = 0x02
+_PKT_FLAG_KEEPALIVE = 0x04
+_PKT_FLAG_HALF_RATE = 0x80
+# STATS / SYNC / CONTROL / BENCH datagrams are never audio; anything with one
+# of these bits set is dropped wholesale.
+_PKT_FLAGS_NON_AUDIO = 0x08 | 0x10 | 0x20 | 0x40
+# Payload encodings this bridge cannot hand to a pcm_s16le WebSocket stream:
+# stereo interleave, ADPCM blocks, half-rate decimation, packed 24-bit.
+_PKT_FLAGS_UNSUPPORTED = _PKT_FLAG_STEREO | _PKT_FLAG_ADPCM | _PKT_FLAG_HALF_RATE
+_PCM_FMT_S16 = 0
+
 
 @dataclass(slots=True)
 class RoleCfg:
@@ -34,15 +54,77 @@ class _UdpProtocol(asyncio.DatagramProtocol):
         self._total_emitted = 0
         self._total_dropped_bytes = 0
         self._frames_dropped_queue = 0
+        self._framed_packets = 0
+        self._nonaudio_dropped = 0
         self._last_log_s = 0.0
 
+    def _unwrap_framed(self, data: bytes) -> bytes | None:
+        """Strip the firmware's 28-byte headers from a framed datagram.
+
+        Returns the concatenated plain-PCM16 payloads (batched datagrams carry
+        several header+payload chunks back to back), or None when the chunk
+        walk does not consume the datagram cleanly - every chunk must carry
+        the magic and version and declare a payload that fits. None tells the
+        caller this is really a legacy bare-PCM16 datagram whose first samples
+        happened to look like a header. Sync/control/stats/bench datagrams,
+        keepalives and payload encodings the server's pcm_s16le stream cannot
+        carry are discarded here rather than forwarded as noise.
+        """
+        out = bytearray()
+        nonaudio = 0
+        off = 0
+        while off < len(data):
+            if len(data) - off < _PKT_HEADER.size:
+                return None  # trailing bytes too short for a header: not framed
+            magic, ver, flags, _seq, _ts, sample_count, fmt, _rms, _peak, _zc, _r2 = _PKT_HEADER.unpack_from(data, off)
+            if magic != _PKT_MAGIC or ver != _PKT_VERSION:
+                return None
+            off += _PKT_HEADER.size
+            if flags & _PKT_FLAGS_NON_AUDIO:
+                # Never batched with audio; the rest of the datagram is its payload.
+                nonaudio += 1
+                off = len(data)
+                break
+            # Work out the payload span so unsupported chunks are skipped,
+            # not misparsed as the next header.
+            if flags & _PKT_FLAG_ADPCM:
+                payload_len = 4 + (sample_count + 1) // 2
+            elif fmt != _PCM_FMT_S16:
+                payload_len = sample_count * 3  # packed s24le
+            else:
+                payload_len = sample_count * 2 * (2 if flags & _PKT_FLAG_STEREO else 1)
+            if flags & _PKT_FLAG_KEEPALIVE:
+                payload_len = 0
+            if off + payload_len > len(data):
+                return None  # declared payload overruns the datagram: not framed
+            payload = data[off : off + payload_len]
+            off += payload_len
+            if payload and not (flags & _PKT_FLAGS_UNSUPPORTED) and fmt == _PCM_FMT_S16:
+                out.extend(payload)
+            elif payload:
+                nonaudio += 1
+        # Counters only move once the whole datagram parsed as framed.
+        self._framed_packets += 1
+        self._nonaudio_dropped += nonaudio
+        return bytes(out)
+
     def datagram_received(self, data: bytes, addr) -> None:  # type: ignore[override]
         if not data:
             return
         self._packets += 1
         self._total_received += len(data)
-        self._buf.extend(data)
         self._last_sender = addr
+        # Candidate framed datagram: magic + version match. A legacy bare-PCM16
+        # datagram can still start with a loud sample 0x4148, so the unwrap
+        # only commits when the chunk walk consumes the datagram cleanly;
+        # otherwise the datagram passes through as legacy audio untouched.
+        if len(data) >= _PKT_HEADER.size and data[0] == 0x48 and data[1] == 0x41 and data[2] == _PKT_VERSION:
+            unwrapped = self._unwrap_framed(data)
+            if unwrapped is not None:
+                if not unwrapped:
+                    return
+                data = unwrapped
+        self._buf.extend(data)
 
         # PCM16 alignment guard: if sender produces odd-length datagrams (or drops bytes),
         # keep the stream aligned by dropping a trailing byte.
@@ -78,14 +160,16 @@ class _UdpProtocol(asyncio.DatagramProtocol):
         if (now - self._last_log_s) >= 2.0:
             self._last_log_s = now
             logging.getLogger("udp_bridge").info(
-                "UDP %s port=%d packets=%d recv=%dB emit=%dB droppedBytes=%dB droppedFrames=%d buf=%dB q=%d",
+                "UDP %s port=%d packets=%d framed=%d recv=%dB emit=%dB droppedBytes=%dB droppedFrames=%d nonAudio=%d buf=%dB q=%d",
                 self._role,
                 self._port,
                 self._packets,
+                self._framed_packets,
                 self._total_received,
                 self._total_emitted,
                 self._total_dropped_bytes,
                 self._frames_dropped_queue,
+                self._nonaudio_dropped,
                 len(self._buf),
                 self._queue.qsize(),
             )